@@ -2,7 +2,9 @@
 #include <App/SettingsDlg.h>
 #include <ArrtVersion.h>
 #include <QDesktopServices>
+#include <QFileInfo>
 #include <QLabel>
+#include <QMenu>
 #include <QMessageBox>
 #include <QProgressBar>
 #include <QSettings>
@@ -49,8 +51,8 @@ ArrtAppWindow::ArrtAppWindow(const ArrtCommandLineOptions& cmdLineOptions)
     else
 	{
         m_arrAclient = std::make_unique<ArrAccount>();
-        m_storageAccount = std::make_unique<StorageAccount>([this](int numFiles, float percentage)
-                                                            { FileUploadStatusCallback(numFiles, percentage); });
+        m_storageAccount = std::make_unique<StorageAccount>([this](const FileUploadProgress& progress)
+                                                            { FileUploadStatusCallback(progress); });
         m_conversionManager = std::make_unique<ConversionManager>(m_storageAccount.get(), m_arrAclient.get());
 	}
 
@@ -126,7 +128,37 @@ ArrtAppWindow::ArrtAppWindow(const ArrtCommandLineOptions& cmdLineOptions)
 
         m_statusStorageAccount = new QLabel(m_statusBar);
         m_statusStorageAccount->setTextFormat(Qt::TextFormat::RichText);
+        m_statusStorageAccount->setContextMenuPolicy(Qt::CustomContextMenu);
         m_statusBar->addWidget(m_statusStorageAccount);
+
+        // running file uploads can be paused, resumed or cancelled through the context menu of the storage status
+        connect(m_statusStorageAccount, &QLabel::customContextMenuRequested, this, [this](const QPoint& pos)
+                {
+                    FileUploader* uploader = m_storageAccount->GetFileUploader();
+                    if (uploader == nullptr || (m_fileUploadProgress.m_remainingFiles == 0 && !m_fileUploadProgress.m_scanning))
+                        return;
+
+                    QMenu menu;
+
+                    if (uploader->AreUploadsPaused())
+                    {
+                        menu.addAction("Resume Uploads", [uploader]()
+                                       { uploader->ResumeAllUploads(); });
+                    }
+                    else
+                    {
+                        menu.addAction("Pause Uploads", [uploader]()
+                                       { uploader->PauseAllUploads(); });
+                    }
+
+                    menu.addAction("Cancel Uploads", [this, uploader]()
+                                   {
+                                       if (QMessageBox::question(this, "Cancel File Uploads?", QString("Do you want to cancel the upload of the remaining %1 files?").arg(m_fileUploadProgress.m_remainingFiles), QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::Yes)
+                                       {
+                                           uploader->CancelAllUploads(false);
+                                       } });
+
+                    menu.exec(m_statusStorageAccount->mapToGlobal(pos)); });
         addSeperator();
 
         m_statusArrAccount = new QLabel(m_statusBar);
@@ -311,12 +343,63 @@ void ArrtAppWindow::OnUpdateStatusBar()
     switch (m_storageAccount->GetConnectionStatus())
     {
         case StorageConnectionStatus::Authenticated:
-            if (m_numFileUploads > 0)
+            if (m_fileUploadProgress.m_remainingFiles > 0 || m_fileUploadProgress.m_scanning)
             {
-                m_statusStorageAccount->setText(QString("<html><head/><body><p>Storage: <span style=\"color:#ffaa00;\">Uploading %1 files: %2%</span></p></body></html>").arg(m_numFileUploads).arg(m_fileUploadPercentage * 100.0, 0, 'f', 2));
+                const FileUploadProgress& progress = m_fileUploadProgress;
+
+                QString details = progress.m_paused ? QString("paused") : QString("%1 MB/s").arg(progress.m_bytesPerSecond / (1024.0 * 1024.0), 0, 'f', 1);
+
+                if (progress.m_secondsRemaining >= 0)
+                {
+                    details += QString(", %1:%2 left").arg(progress.m_secondsRemaining / 60).arg(progress.m_secondsRemaining % 60, 2, 10, QChar('0'));
+                }
+
+                if (progress.m_scanning)
+                {
+                    details += ", scanning folders";
+                }
+
+                if (progress.m_failedFiles > 0)
+                {
+                    details += QString(", %1 failed").arg(progress.m_failedFiles);
+                }
+
+                if (progress.m_skippedFiles > 0)
+                {
+                    details += QString(", %1 unchanged").arg(progress.m_skippedFiles);
+                }
+
+                m_statusStorageAccount->setText(QString("<html><head/><body><p>Storage: <span style=\"color:#ffaa00;\">Uploading %1 files: %2% (%3)</span></p></body></html>").arg(progress.m_remainingFiles).arg(progress.m_percentage * 100.0, 0, 'f', 2).arg(details));
+
+                QString tooltip;
+                for (const FileUploadState& file : progress.m_activeFiles)
+                {
+                    const double filePercentage = (file.m_totalBytes > 0) ? (100.0 * file.m_uploadedBytes / file.m_totalBytes) : 100.0;
+                    tooltip += QString("%1: %2%\n").arg(QFileInfo(file.m_sourceFilePath).fileName()).arg(filePercentage, 0, 'f', 1);
+                }
+
+                if (progress.m_retriedBlocks > 0)
+                {
+                    tooltip += QString("Retried blocks: %1\n").arg(progress.m_retriedBlocks);
+                }
+
+                if (progress.m_waitingRetries > 0)
+                {
+                    tooltip += QString("Blocks waiting to be sent again: %1\n").arg(progress.m_waitingRetries);
+                }
+
+                if (progress.m_skippedFiles > 0)
+                {
+                    tooltip += QString("Skipped unchanged files: %1 (%2 MB)\n").arg(progress.m_skippedFiles).arg(progress.m_skippedBytes / (1024.0 * 1024.0), 0, 'f', 2);
+                }
+
+                tooltip += "Right-click to pause or cancel the uploads.";
+
+                m_statusStorageAccount->setToolTip(tooltip);
             }
             else
             {
+                m_statusStorageAccount->setToolTip(QString());
                 m_statusStorageAccount->setText("<html><head/><body><p>Storage: <span style=\"color:#00aa00;\">Connected</span></p></body></html>");
             }
             break;
@@ -476,9 +559,9 @@ void ArrtAppWindow::closeEvent(QCloseEvent* e)
 {
     SaveSettings();
 
-    if (m_numFileUploads > 0)
+    if (m_fileUploadProgress.m_remainingFiles > 0 || m_fileUploadProgress.m_scanning)
     {
-        if (QMessageBox::question(this, "Cancel File Uploads?", QString("%1 files are currently being uploaded. Closing ARRT will cancel all uploads.\n\nContinue anyway?").arg(m_numFileUploads), QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::No)
+        if (QMessageBox::question(this, "Cancel File Uploads?", QString("%1 files are currently being uploaded. Closing ARRT will cancel all uploads.\n\nContinue anyway?").arg(m_fileUploadProgress.m_remainingFiles), QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::No)
         {
             e->setAccepted(false);
             return;
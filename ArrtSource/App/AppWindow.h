@@ -3,6 +3,7 @@
 #include "ui_AppWindow.h"
 #include <Conversion/ConversionManager.h>
 #include <QMainWindow>
+#include <Storage/FileUploader.h>
 #include <memory>
 
 class QStatusBar;
@@ -93,7 +94,7 @@ private:
     void SaveSettings();
     void CheckForNewVersion();
     void OnCheckForNewVersionResult(QString latestVersion);
-    void FileUploadStatusCallback(int numFiles, float percentage);
+    void FileUploadStatusCallback(const FileUploadProgress& progress);
     void UpdateConversionsList();
     void UpdateConversionPane();
     void UpdateConversionStartButton();
@@ -110,8 +111,7 @@ private:
     QLabel* m_statusArrAccount = nullptr;
     QLabel* m_statusArrSession = nullptr;
     QProgressBar* m_statusLoadProgress = nullptr;
-    int m_numFileUploads = 0;
-    float m_fileUploadPercentage = 0;
+    FileUploadProgress m_fileUploadProgress;
     int m_maxLogType = 0;
     bool m_logClearMsgAdded = true;
     QAction* m_loadFromStorageAction = nullptr;
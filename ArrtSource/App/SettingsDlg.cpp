@@ -58,6 +58,27 @@ SettingsDlg::SettingsDlg(StorageAccount* storage, ArrAccount* arrClient, QWidget
     PushProfile();
     SetActiveProfile(m_activeProfile);
 
+    if (FileUploader* uploader = m_storageAccount->GetFileUploader())
+    {
+        ParallelUploads->setValue(uploader->GetMaxParallelUploads());
+        ResumeUploads->setChecked(uploader->GetResumeUploads());
+        SkipUnchangedFiles->setChecked(uploader->GetSkipUnchangedFiles());
+        AdaptiveBlockSize->setChecked(uploader->GetAdaptiveBlockSize());
+        DeltaUploads->setChecked(uploader->GetDeltaUploads());
+        UploadBandwidthLimit->setValue(uploader->GetMaxBytesPerSecond() / (1024.0 * 1024.0));
+    }
+    else
+    {
+        ParallelUploads->setEnabled(false);
+        ResumeUploads->setEnabled(false);
+        SkipUnchangedFiles->setEnabled(false);
+        AdaptiveBlockSize->setEnabled(false);
+        DeltaUploads->setEnabled(false);
+        UploadBandwidthLimit->setEnabled(false);
+    }
+
+    RememberListings->setChecked(m_storageAccount->GetUseListingIndex());
+
     QPushButton* closeButton = Buttons->button(QDialogButtonBox::Close);
     closeButton->setAutoDefault(false);
     closeButton->setDefault(false);
@@ -71,6 +92,7 @@ void SettingsDlg::closeEvent(QCloseEvent*)
     SaveProfiles();
     ApplyArr();
     ApplyStorage();
+    ApplyUploads();
 }
 
 void SettingsDlg::on_Buttons_rejected()
@@ -223,9 +245,25 @@ bool SettingsDlg::ApplyArr()
 void SettingsDlg::ApplyStorage()
 {
     m_storageAccount->SetSettings(StorageName->text(), StorageKey->text(), StorageEndpoint->text());
+    m_storageAccount->SetUseListingIndex(RememberListings->isChecked());
+    m_storageAccount->SaveSettings();
     m_storageAccount->ConnectToStorageAccount();
 }
 
+void SettingsDlg::ApplyUploads()
+{
+    if (FileUploader* uploader = m_storageAccount->GetFileUploader())
+    {
+        uploader->SetMaxParallelUploads(ParallelUploads->value());
+        uploader->SetResumeUploads(ResumeUploads->isChecked());
+        uploader->SetSkipUnchangedFiles(SkipUnchangedFiles->isChecked());
+        uploader->SetAdaptiveBlockSize(AdaptiveBlockSize->isChecked());
+        uploader->SetDeltaUploads(DeltaUploads->isChecked());
+        uploader->SetMaxBytesPerSecond((int64_t)(UploadBandwidthLimit->value() * 1024.0 * 1024.0));
+        uploader->SaveSettings();
+    }
+}
+
 void SettingsDlg::FillProfiles()
 {
     if (ProfileDropDown->count() == m_profiles.size())
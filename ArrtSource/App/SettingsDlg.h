@@ -38,6 +38,7 @@ private Q_SLOTS:
 private:
     bool ApplyArr();
     void ApplyStorage();
+    void ApplyUploads();
     void FillProfiles();
     void SetActiveProfile(const QString& name);
     void PullProfile();
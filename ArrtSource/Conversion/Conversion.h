@@ -6,6 +6,7 @@
 enum class ConversionStatus
 {
     New,
+    Starting,
     Running,
     Finished,
     Failed,
@@ -138,6 +139,7 @@ struct Conversion
     QString m_outputFolder;
     bool m_showAdvancedOptions = false;
     QString m_conversionGuid;
+    uint64_t m_id = 0; ///< Identifies the conversion while it is being started, since its position in the list can change in the meantime.
     QString m_message;
     uint64_t m_startConversionTime;
     uint64_t m_endConversionTime;
@@ -92,20 +92,13 @@ bool ConversionManager::StartConversion()
         conv.m_name = conv.GetPlaceholderName();
     }
 
-    if (!StartConversionInternal())
-    {
-        conv.m_status = ConversionStatus::New;
-        Q_EMIT SelectedChanged();
-        return false;
-    }
-
-    conv.m_status = ConversionStatus::Running;
-    Q_EMIT SelectedChanged();
-
-    m_conversions.push_back({});
-    SetupConversion(m_conversions.back());
+    // the input folder is checked in the background, the conversion is only submitted afterwards
+    conv.m_status = ConversionStatus::Starting;
+    conv.m_id = m_nextConversionId++;
     Q_EMIT ListChanged();
+    Q_EMIT SelectedChanged();
 
+    CheckInputFolder(m_selectedConversion);
     return true;
 }
 
@@ -259,52 +252,108 @@ void ConversionManager::OnCheckConversions()
     }
 }
 
-bool ConversionManager::StartConversionInternal()
+void ConversionManager::CheckInputFolder(int conversionIdx)
 {
-    auto& conv = m_conversions[m_selectedConversion];
+    const auto& conv = m_conversions[conversionIdx];
+    const uint64_t conversionId = conv.m_id;
 
+    // if the source asset is a point cloud, the whole folder won't be downloaded, so the folder content doesn't matter
+    if (StorageBrowserModel::IsSingleFileAsset(conv.m_sourceAsset))
     {
-        std::deque<QString> folders;
-        folders.push_back(conv.m_inputFolder);
-        int srcAssets = 0;
-
-        while (!folders.empty())
-        {
-            QString srcFolder = folders.front();
-            folders.pop_front();
+        FinishStartConversion(conversionId, 0);
+        return;
+    }
 
-            std::vector<StorageBlobInfo> dirs, files;
-            m_storageAccount->ListBlobDirectory(conv.m_sourceAssetContainer, srcFolder, dirs, files);
+    auto srcAssets = std::make_shared<int>(0);
 
-            for (const auto& file : files)
+    // a single flat listing covers all nested folders, and it stops as soon as a second source asset shows up
+    auto pageCallback = [srcAssets](const std::vector<StorageBlobInfo>&, const std::vector<StorageBlobInfo>& files, const QString&)
+    {
+        for (const auto& file : files)
+        {
+            if (StorageBrowserModel::IsSrcAsset(file.m_path))
             {
-                if (StorageBrowserModel::IsSrcAsset(file.m_path))
-                {
-                    srcAssets++;
-                }
+                (*srcAssets)++;
             }
+        }
 
-            if (srcAssets > 1 && !StorageBrowserModel::IsSingleFileAsset(conv.m_sourceAsset))
-            {
-                // if the source asset is a point cloud, the whole folder won't be downloaded, so the warning isn't needed
-                if (QMessageBox::warning(nullptr, "Multiple Source Assets Found", QString("The folder of the input asset contains %1 asset files (GLB, GLTF, FBX, E57, PLY, XYZ, LAS, LAZ). The conversion service needs to download the entire folder. The more unrelated data is in that folder, the longer the conversion will take because of this download.\n\nFor best conversion speed, every asset (and its accompanying files, such as textures) should reside in its own folder.\n\nContinue anyway?").arg(srcAssets), QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::No)
-                {
-                    return false;
-                }
-                else
-                {
-                    // asked once, don't ask again
-                    break;
-                }
-            }
+        return *srcAssets <= 1;
+    };
 
-            for (const auto& dir : dirs)
-            {
-                folders.push_back(dir.m_path);
-            }
+    // if the listing fails, the conversion is started anyway, the warning is only a hint
+    // conversions that are fetched from the service may be inserted into the list in the meantime, so the conversion is looked up by its ID afterwards
+    auto finishedCallback = [manager = QPointer<ConversionManager>(this), conversionId, srcAssets](bool)
+    {
+        QMetaObject::invokeMethod(QApplication::instance(), [manager, conversionId, srcAssets]()
+                                  {
+                                      if (manager)
+                                      {
+                                          manager->FinishStartConversion(conversionId, *srcAssets);
+                                      } });
+    };
+
+    m_storageAccount->ListBlobsRecursiveAsync(conv.m_sourceAssetContainer, conv.m_inputFolder, std::move(pageCallback), std::move(finishedCallback));
+}
+
+int ConversionManager::FindConversion(uint64_t conversionId) const
+{
+    for (size_t conversionIdx = 0; conversionIdx < m_conversions.size(); ++conversionIdx)
+    {
+        if (m_conversions[conversionIdx].m_id == conversionId)
+            return (int)conversionIdx;
+    }
+
+    return -1;
+}
+
+void ConversionManager::FinishStartConversion(uint64_t conversionId, int srcAssets)
+{
+    int conversionIdx = FindConversion(conversionId);
+
+    if (conversionIdx < 0 || m_conversions[conversionIdx].m_status != ConversionStatus::Starting)
+        return;
+
+    if (srcAssets > 1)
+    {
+        const bool cancel = QMessageBox::warning(nullptr, "Multiple Source Assets Found", QString("The folder of the input asset contains %1 asset files (GLB, GLTF, FBX, E57, PLY, XYZ, LAS, LAZ). The conversion service needs to download the entire folder. The more unrelated data is in that folder, the longer the conversion will take because of this download.\n\nFor best conversion speed, every asset (and its accompanying files, such as textures) should reside in its own folder.\n\nContinue anyway?").arg(srcAssets), QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::No;
+
+        // the message box runs the event loop, so the list may have changed while it was open
+        conversionIdx = FindConversion(conversionId);
+
+        if (conversionIdx < 0)
+            return;
+
+        if (cancel)
+        {
+            m_conversions[conversionIdx].m_status = ConversionStatus::New;
+            Q_EMIT ListChanged();
+            Q_EMIT SelectedChanged();
+            return;
         }
     }
 
+    auto& conv = m_conversions[conversionIdx];
+
+    if (!StartConversionInternal(conversionIdx))
+    {
+        conv.m_status = ConversionStatus::New;
+        Q_EMIT ListChanged();
+        Q_EMIT SelectedChanged();
+        return;
+    }
+
+    conv.m_status = ConversionStatus::Running;
+    Q_EMIT SelectedChanged();
+
+    m_conversions.push_back({});
+    SetupConversion(m_conversions.back());
+    Q_EMIT ListChanged();
+}
+
+bool ConversionManager::StartConversionInternal(int conversionIdx)
+{
+    auto& conv = m_conversions[conversionIdx];
+
     {
         QString advancedOptionsJSON = conv.m_options.ToJSON(conv.m_availableOptions);
 
@@ -370,8 +419,6 @@ bool ConversionManager::StartConversionInternal()
     output.StorageContainerWriteSas = outputSasToken.toStdString();
     output.StorageContainerUri = outputUri.toStdString();
 
-    int conversionIdx = m_selectedConversion;
-
     qDebug(LoggingCategory::ArrSdk) << QString("Starting conversion '%1' (%2)").arg(conv.m_name).arg(conv.m_conversionGuid);
 
     qDebug(LoggingCategory::ArrSdk) << QString("Input Container URI = '%1'").arg(input.StorageContainerUri.c_str());
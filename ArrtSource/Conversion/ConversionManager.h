@@ -39,6 +39,9 @@ public:
     bool IsEditableSelected() const;
 
     /// Starts the next conversion with the currently set options.
+    ///
+    /// The conversion is in the 'Starting' state until the input folder was checked, and it goes back to 'New',
+    /// if the user decides not to start it after all.
     bool StartConversion();
 
     void SetConversionName(const QString& name);
@@ -59,7 +62,10 @@ protected Q_SLOTS:
 
 protected:
     virtual void SetupConversion(Conversion&);
-    bool StartConversionInternal();
+    void CheckInputFolder(int conversionIdx);
+    void FinishStartConversion(uint64_t conversionId, int srcAssets);
+    int FindConversion(uint64_t conversionId) const;
+    bool StartConversionInternal(int conversionIdx);
     void SetConversionStatus(int conversionIdx, RR::Status status, RR::ApiHandle<RR::ConversionPropertiesResult> result);
     void GetCurrentConversionsResult(RR::Status status, RR::ApiHandle<RR::ConversionPropertiesArrayResult> result);
 
@@ -70,6 +76,7 @@ protected:
 
     int m_selectedConversion = 0;
     std::deque<Conversion> m_conversions;
+    uint64_t m_nextConversionId = 1;
 };
 
 class ConversionManagerMock : public ConversionManager
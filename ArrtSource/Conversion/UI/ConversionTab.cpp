@@ -57,6 +57,12 @@ void ArrtAppWindow::UpdateConversionsList()
                 text = "<new conversion>";
                 break;
             }
+            case ConversionStatus::Starting:
+            {
+                item->setIcon(QIcon::fromTheme("conversion_running"));
+                text += QString(" (starting)");
+                break;
+            }
             case ConversionStatus::Running:
             {
                 const uint64_t duration = QDateTime::currentSecsSinceEpoch() - conv.m_startConversionTime;
@@ -186,6 +192,9 @@ void ArrtAppWindow::UpdateConversionPane()
         case ConversionStatus::Finished:
             ConversionTab->ConversionMessage->setText("Conversion finished successfully");
             break;
+        case ConversionStatus::Starting:
+            ConversionTab->ConversionMessage->setText("Checking the input folder");
+            break;
         case ConversionStatus::Running:
             ConversionTab->ConversionMessage->setText("Conversion currently running");
             break;
@@ -0,0 +1,100 @@
+#include <Storage/BlobJob.h>
+
+// enough to tell the user what went wrong, without keeping thousands of messages around
+static constexpr int s_maxReportedFailures = 20;
+
+BlobJob::BlobJob(ProgressCallback progressCallback)
+    : m_progressCallback(std::move(progressCallback))
+{
+}
+
+void BlobJob::Cancel()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_cancelled)
+        return;
+
+    m_cancelled = true;
+    m_context.Cancel();
+}
+
+BlobJobProgress BlobJob::GetProgress() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    BlobJobProgress progress = m_progress;
+    progress.m_cancelled = m_cancelled;
+    return progress;
+}
+
+void BlobJob::AddFoundBlobs(int64_t numBlobs, int64_t numBytes, int numTasks)
+{
+    UpdateProgress([&]()
+                   {
+                       m_progress.m_foundBlobs += numBlobs;
+                       m_progress.m_foundBytes += numBytes;
+                       m_pendingTasks += numTasks;
+                   });
+}
+
+void BlobJob::FinishListing(bool success)
+{
+    UpdateProgress([&]()
+                   {
+                       m_progress.m_listingFinished = true;
+                       m_progress.m_listingFailed = !success;
+                   });
+}
+
+void BlobJob::FinishTask(int64_t completedBlobs, int64_t completedBytes, const QStringList& failures)
+{
+    UpdateProgress([&]()
+                   {
+                       --m_pendingTasks;
+                       m_progress.m_completedBlobs += completedBlobs;
+                       m_progress.m_completedBytes += completedBytes;
+                       m_progress.m_failedBlobs += failures.size();
+
+                       for (const QString& failure : failures)
+                       {
+                           if (m_progress.m_failures.size() >= s_maxReportedFailures)
+                               break;
+
+                           m_progress.m_failures.append(failure);
+                       }
+                   });
+}
+
+void BlobJob::AddTransferredBytes(int64_t bytes)
+{
+    UpdateProgress([&]()
+                   { m_progress.m_transferredBytes += bytes; });
+}
+
+void BlobJob::UpdateProgress(const std::function<void()>& update)
+{
+    // serializes the callbacks, so that the updates arrive in order, without holding m_mutex while the callback runs
+    std::lock_guard<std::mutex> callbackLock(m_callbackMutex);
+
+    BlobJobProgress progress;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        update();
+
+        if (m_progress.m_finished)
+            return;
+
+        m_progress.m_cancelled = m_cancelled;
+        m_progress.m_finished = m_progress.m_listingFinished && m_pendingTasks == 0;
+        progress = m_progress;
+    }
+
+    // the callback may call back into the job, for example to cancel it or to get the progress
+    if (m_progressCallback)
+    {
+        m_progressCallback(progress);
+    }
+}
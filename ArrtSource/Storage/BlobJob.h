@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QStringList>
+#include <Storage/IncludeAzureStorage.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+/// The state of a BlobJob, passed to the progress callback.
+struct BlobJobProgress
+{
+    int64_t m_foundBlobs = 0;       ///< How many blobs the listing found so far. This is the total, once m_listingFinished is true.
+    int64_t m_foundBytes = 0;       ///< The size of all blobs that were found so far.
+    int64_t m_completedBlobs = 0;   ///< How many blobs were processed successfully.
+    int64_t m_completedBytes = 0;   ///< The size of all blobs that were processed successfully.
+    int64_t m_failedBlobs = 0;      ///< How many blobs could not be processed.
+    int64_t m_transferredBytes = 0; ///< For downloads, how much data has arrived so far, including parts of files that aren't complete yet.
+    bool m_listingFinished = false;
+    bool m_listingFailed = false;   ///< If true, not all blobs were found, so some may not have been processed, even if none failed.
+    bool m_cancelled = false;
+    bool m_finished = false; ///< Set in the very last update, no more updates follow.
+
+    /// Some of the failed blobs together with the reason, for reporting. Not all failures are kept, see m_failedBlobs for the number.
+    QStringList m_failures;
+};
+
+/// A handle to an operation on many blobs, such as StorageAccount::DeleteFolderAsync(), StorageAccount::CopyItemAsync() or FileDownloader::DownloadItemAsync().
+///
+/// The blobs are listed page by page, and the blobs of every page are split into tasks, which run in parallel.
+/// Cancelling aborts the requests that are in flight and doesn't start any new tasks. Blobs that were processed already, stay that way.
+class BlobJob
+{
+public:
+    using ProgressCallback = std::function<void(const BlobJobProgress&)>;
+
+    BlobJob(ProgressCallback progressCallback);
+
+    /// Stops the job. This can't be undone.
+    void Cancel();
+
+    /// Whether the job was cancelled.
+    bool IsCancelled() const { return m_cancelled; }
+
+    /// The context to pass to all Azure Storage requests of this job.
+    const Azure::Core::Context& GetContext() const { return m_context; }
+
+    /// Returns a snapshot of the current state.
+    BlobJobProgress GetProgress() const;
+
+private:
+    friend class FileDownloader;
+    friend class StorageAccount;
+
+    /// Called by the listing for every page, before the tasks of the page are queued.
+    void AddFoundBlobs(int64_t numBlobs, int64_t numBytes, int numTasks);
+
+    /// Called when all blobs were listed or the listing failed.
+    void FinishListing(bool success);
+
+    /// Called whenever one task has finished. 'failures' holds one message per blob that could not be processed.
+    void FinishTask(int64_t completedBlobs, int64_t completedBytes, const QStringList& failures);
+
+    /// Called whenever a part of a blob has been transferred, before the task of the blob has finished.
+    void AddTransferredBytes(int64_t bytes);
+
+    /// Applies 'update' to the progress under the mutex and passes a copy to the progress callback, after unlocking it.
+    /// Updates from different threads still arrive in order, and nothing arrives after the update that finished the job.
+    void UpdateProgress(const std::function<void()>& update);
+
+    mutable std::mutex m_mutex;
+    std::mutex m_callbackMutex;
+    BlobJobProgress m_progress;
+    int m_pendingTasks = 0;
+    ProgressCallback m_progressCallback;
+    std::atomic<bool> m_cancelled = false;
+    Azure::Core::Context m_context;
+};
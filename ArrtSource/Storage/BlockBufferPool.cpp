@@ -0,0 +1,81 @@
+#include <Storage/BlockBufferPool.h>
+
+BlockBuffer BlockBufferPool::Acquire(int64_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return Take(size);
+}
+
+BlockBuffer BlockBufferPool::TryAcquire(int64_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_usedBytes + size > s_memoryBudget)
+        return {};
+
+    return Take(size);
+}
+
+void BlockBufferPool::Release(BlockBuffer&& buffer)
+{
+    if (!buffer.IsValid())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_usedBytes -= buffer.m_capacity;
+
+    // the free buffers are only kept within the budget, the rest is freed right away
+    if (m_usedBytes + m_freeBytes + buffer.m_capacity > s_memoryBudget)
+        return;
+
+    m_freeBytes += buffer.m_capacity;
+    m_freeBuffers.push_back(std::move(buffer));
+}
+
+bool BlockBufferPool::IsOverBudget() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_usedBytes > s_memoryBudget;
+}
+
+BlockBuffer BlockBufferPool::Take(int64_t size)
+{
+    // the smallest free buffer that is large enough wastes the least memory
+    int bestIdx = -1;
+
+    for (int i = 0; i < (int)m_freeBuffers.size(); ++i)
+    {
+        const int64_t capacity = m_freeBuffers[i].m_capacity;
+
+        if (capacity >= size && (bestIdx < 0 || capacity < m_freeBuffers[bestIdx].m_capacity))
+        {
+            bestIdx = i;
+        }
+    }
+
+    BlockBuffer buffer;
+
+    if (bestIdx >= 0)
+    {
+        buffer = std::move(m_freeBuffers[bestIdx]);
+        m_freeBuffers.erase(m_freeBuffers.begin() + bestIdx);
+        m_freeBytes -= buffer.m_capacity;
+    }
+    else
+    {
+        // the free buffers are all too small, once the block size has grown they aren't going to be used again
+        if (m_usedBytes + m_freeBytes + size > s_memoryBudget)
+        {
+            m_freeBuffers.clear();
+            m_freeBytes = 0;
+        }
+
+        // the data is overwritten right away, so there is no need to initialize it
+        buffer.m_data.reset(new uint8_t[size]);
+        buffer.m_capacity = size;
+    }
+
+    m_usedBytes += buffer.m_capacity;
+    return buffer;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// Memory for the data of one block that is uploaded. Only movable, it goes back to the pool with BlockBufferPool::Release().
+class BlockBuffer
+{
+public:
+    BlockBuffer() = default;
+    BlockBuffer(BlockBuffer&&) = default;
+    BlockBuffer& operator=(BlockBuffer&&) = default;
+
+    bool IsValid() const { return m_data != nullptr; }
+
+    uint8_t* GetData() const { return m_data.get(); }
+
+    int64_t GetCapacity() const { return m_capacity; }
+
+private:
+    friend class BlockBufferPool;
+
+    std::unique_ptr<uint8_t[]> m_data;
+    int64_t m_capacity = 0;
+};
+
+/// Reusable buffers for the blocks of file uploads.
+///
+/// Blocks are up to 64 MB large, allocating and freeing that much for every block is expensive, so released buffers are kept for the next blocks.
+/// Buffers for reading ahead are only handed out while the memory in use stays within a budget, so reading ahead never holds back the uploads themselves.
+/// The buffers that the uploads need right away are handed out beyond the budget, the uploader bounds those itself, see Acquire().
+class BlockBufferPool
+{
+public:
+    /// How much memory the buffers of all uploads may take, before reading ahead stops and released buffers are freed.
+    static constexpr int64_t s_memoryBudget = 512 * 1024 * 1024;
+
+    /// Returns a buffer of at least the given size. This always succeeds, even if the budget is used up.
+    ///
+    /// Waiting for the budget instead could block the very block that the buffers kept for later are waiting for.
+    /// So the memory isn't bounded here: the uploader holds at most one of these buffers per worker at a time,
+    /// and limits the block size to the budget divided by the number of workers, so all buffers together take at most twice the budget.
+    BlockBuffer Acquire(int64_t size);
+
+    /// Returns a buffer of at least the given size, or an invalid buffer, if that would exceed the budget.
+    BlockBuffer TryAcquire(int64_t size);
+
+    /// Returns a buffer to the pool, so that it can be reused. Invalid buffers are ignored.
+    void Release(BlockBuffer&& buffer);
+
+    /// Whether the buffers in use take more memory than the budget allows, TryAcquire() fails while this is the case.
+    /// Buffers that are only kept for later, should be released then.
+    bool IsOverBudget() const;
+
+private:
+    BlockBuffer Take(int64_t size);
+
+    mutable std::mutex m_mutex;
+    std::vector<BlockBuffer> m_freeBuffers;
+    int64_t m_freeBytes = 0;
+    int64_t m_usedBytes = 0;
+};
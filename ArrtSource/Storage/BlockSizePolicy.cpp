@@ -0,0 +1,148 @@
+#include <Storage/BlockSizePolicy.h>
+#include <algorithm>
+
+constexpr int64_t GetMB(int64_t bytes)
+{
+    return 1024i64 * 1024i64 * bytes;
+}
+constexpr int64_t GetGB(int64_t bytes)
+{
+    return 1024i64 * 1024i64 * 1024i64 * bytes;
+}
+
+// blocks of up to 100 MB would be possible, but become more and more unreliable
+static constexpr int64_t s_minAdaptiveBlockSize = GetMB(1);
+static constexpr int64_t s_maxAdaptiveBlockSize = GetMB(64);
+static constexpr int64_t s_initialAdaptiveBlockSize = GetMB(4);
+
+// the adaptive block size aims for blocks that take this long to upload
+// long enough that the per-request overhead doesn't matter, short enough that a failed block doesn't cost much
+static constexpr double s_targetSecondsPerBlock = 4.0;
+
+// how many blocks in a row need to go through without retries, before the block size is increased
+static constexpr int s_stableBlocksToGrow = 3;
+
+int64_t BlockSizePolicy::GetFixedBlockSize(int64_t fileSize)
+{
+    // for larger files, we mustn't use too many blocks, otherwise the commit fails, so use larger chunks there
+
+    if (fileSize > GetGB(8))
+        return GetMB(32);
+
+    if (fileSize > GetGB(4))
+        return GetMB(16);
+
+    if (fileSize > GetGB(2))
+        return GetMB(8);
+
+    if (fileSize > GetGB(1))
+        return GetMB(4);
+
+    return GetMB(2);
+}
+
+void BlockSizePolicy::SetAdaptive(bool enable)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_adaptive = enable;
+}
+
+bool BlockSizePolicy::IsAdaptive() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_adaptive;
+}
+
+void BlockSizePolicy::SetMaxBlockSize(int64_t maxBlockSize)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxBlockSize = maxBlockSize;
+}
+
+int64_t BlockSizePolicy::GetBlockSize(int64_t fileSize, int64_t remainingBytes, int64_t remainingBlocks) const
+{
+    int64_t blockSize = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_adaptive)
+        {
+            blockSize = (m_blockSize > 0) ? m_blockSize : s_initialAdaptiveBlockSize;
+        }
+        else
+        {
+            blockSize = GetFixedBlockSize(fileSize);
+        }
+
+        if (m_maxBlockSize > 0)
+        {
+            blockSize = std::min(blockSize, m_maxBlockSize);
+        }
+    }
+
+    // with too small blocks, the rest of the file wouldn't fit into the blob anymore
+    const int64_t minBlockSize = (remainingBytes + std::max<int64_t>(1, remainingBlocks) - 1) / std::max<int64_t>(1, remainingBlocks);
+
+    return std::max(blockSize, minBlockSize);
+}
+
+void BlockSizePolicy::ReportBlockStaged(int64_t bytes, int64_t milliseconds, int retries)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_adaptive)
+        return;
+
+    if (m_blockSize == 0)
+    {
+        m_blockSize = s_initialAdaptiveBlockSize;
+    }
+
+    if (retries > 0)
+    {
+        ShrinkBlockSize();
+        return;
+    }
+
+    // tiny blocks (the end of a file) say more about latency than about throughput
+    if (bytes < s_minAdaptiveBlockSize)
+        return;
+
+    const double bytesPerSecond = bytes / (std::max<int64_t>(1, milliseconds) / 1000.0);
+
+    // smooth the measurements, single blocks vary a lot
+    m_bytesPerSecond = (m_bytesPerSecond > 0.0) ? (0.7 * m_bytesPerSecond + 0.3 * bytesPerSecond) : bytesPerSecond;
+
+    const double targetBlockSize = m_bytesPerSecond * s_targetSecondsPerBlock;
+
+    if (targetBlockSize < m_blockSize / 2)
+    {
+        // the connection got slower
+        m_stableBlocks = 0;
+        m_blockSize = std::max(s_minAdaptiveBlockSize, m_blockSize / 2);
+        return;
+    }
+
+    if (++m_stableBlocks >= s_stableBlocksToGrow && targetBlockSize >= m_blockSize * 2)
+    {
+        m_stableBlocks = 0;
+        m_blockSize = std::min(s_maxAdaptiveBlockSize, m_blockSize * 2);
+    }
+}
+
+void BlockSizePolicy::ReportBlockFailed()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_adaptive)
+        return;
+
+    ShrinkBlockSize();
+}
+
+void BlockSizePolicy::ShrinkBlockSize()
+{
+    m_stableBlocks = 0;
+    m_blockSize = std::max(s_minAdaptiveBlockSize, ((m_blockSize > 0) ? m_blockSize : s_initialAdaptiveBlockSize) / 2);
+}
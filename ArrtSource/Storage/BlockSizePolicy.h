@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+
+/// Decides how large the blocks ('chunks') are, in which files are uploaded.
+///
+/// In adaptive mode, the block size follows the measured upload speed: it grows on fast and stable connections,
+/// which reduces the per-request overhead, and shrinks after retries or failures, so that less data has to be sent again.
+/// In fixed mode, the block size only depends on the file size.
+/// In both modes the block size is chosen such that no file needs more blocks than a blob can hold.
+///
+/// The measurements are shared by all uploads, since they all go through the same connection.
+class BlockSizePolicy
+{
+public:
+    /// A block blob can't consist of more blocks than this.
+    static constexpr int64_t s_maxBlocksPerBlob = 50000;
+
+    /// Returns the block size that fixed mode uses for a file of the given size.
+    static int64_t GetFixedBlockSize(int64_t fileSize);
+
+    void SetAdaptive(bool enable);
+    bool IsAdaptive() const;
+
+    /// Limits the block size in both modes, unless a file would need more blocks than a blob can hold otherwise. Zero means no limit.
+    void SetMaxBlockSize(int64_t maxBlockSize);
+
+    /// Returns the size for the next block of a file.
+    ///
+    /// 'remainingBytes' is how much of the file still needs to be split into blocks, 'remainingBlocks' how many blocks the blob can still take.
+    int64_t GetBlockSize(int64_t fileSize, int64_t remainingBytes, int64_t remainingBlocks) const;
+
+    /// Reports that a block was staged successfully, how long it took and how often the Storage SDK had to retry sending it.
+    void ReportBlockStaged(int64_t bytes, int64_t milliseconds, int retries);
+
+    /// Reports that staging a block failed.
+    void ReportBlockFailed();
+
+private:
+    void ShrinkBlockSize();
+
+    mutable std::mutex m_mutex;
+    bool m_adaptive = true;
+    int64_t m_blockSize = 0;
+    int64_t m_maxBlockSize = 0;
+    double m_bytesPerSecond = 0.0;
+    int m_stableBlocks = 0;
+};
@@ -0,0 +1,85 @@
+#include <Storage/BlockSizePolicy.h>
+#include <Storage/ContentChunker.h>
+#include <algorithm>
+#include <array>
+#include <random>
+
+// chunks may be this much smaller or larger than the average, the limits keep the number of blocks and the size of single requests in check
+static constexpr int64_t s_minChunkSizeDivisor = 4;
+static constexpr int64_t s_maxChunkSizeFactor = 4;
+
+// the rolling hash shifts by one bit per byte, so after this many bytes, older data has no influence anymore
+static constexpr int64_t s_hashWindow = 64;
+
+// one random value for every byte value, which the rolling hash adds up
+static const std::array<uint64_t, 256>& GetGearTable()
+{
+    // the table has to be the same in every run, otherwise no chunk boundaries would ever match those of earlier uploads
+    // std::mt19937_64 is fully specified by the standard, so it produces the same sequence everywhere
+    static const std::array<uint64_t, 256> table = []()
+    {
+        std::array<uint64_t, 256> values;
+        std::mt19937_64 rng(0x41525254);
+
+        for (uint64_t& value : values)
+        {
+            value = rng();
+        }
+
+        return values;
+    }();
+
+    return table;
+}
+
+ContentChunker::ContentChunker(int64_t fileSize)
+{
+    // even if every chunk had the minimum size, the file mustn't need more blocks than a blob can hold
+    int64_t averageChunkSize = s_minAverageChunkSize;
+    while (fileSize / (averageChunkSize / s_minChunkSizeDivisor) >= BlockSizePolicy::s_maxBlocksPerBlob)
+    {
+        averageChunkSize *= 2;
+    }
+
+    m_minChunkSize = averageChunkSize / s_minChunkSizeDivisor;
+    m_maxChunkSize = averageChunkSize * s_maxChunkSizeFactor;
+
+    int bits = 0;
+    while ((int64_t(1) << bits) < averageChunkSize)
+    {
+        ++bits;
+    }
+
+    // a boundary is where the top bits of the hash are all zero, which happens once every 'averageChunkSize' bytes on average
+    // the top bits are used, since they depend on the entire window, the lowest bits only depend on the last few bytes
+    m_boundaryMask = ~uint64_t(0) << (64 - bits);
+}
+
+int64_t ContentChunker::GetChunkLength(const uint8_t* data, int64_t length) const
+{
+    if (length <= m_minChunkSize)
+        return length;
+
+    const std::array<uint64_t, 256>& gear = GetGearTable();
+    const int64_t end = std::min(length, m_maxChunkSize);
+
+    uint64_t hash = 0;
+    int64_t i = m_minChunkSize - s_hashWindow;
+
+    // no boundaries are allowed before the minimum chunk size, but the window in front of it has to be hashed,
+    // so that the first possible boundary depends only on the content as well, and not on where the chunk started
+    for (; i < m_minChunkSize; ++i)
+    {
+        hash = (hash << 1) + gear[data[i]];
+    }
+
+    for (; i < end; ++i)
+    {
+        hash = (hash << 1) + gear[data[i]];
+
+        if ((hash & m_boundaryMask) == 0)
+            return i + 1;
+    }
+
+    return end;
+}
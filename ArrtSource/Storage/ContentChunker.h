@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+/// Splits data into chunks at positions that depend on the content, not on the offset ("content-defined chunking").
+///
+/// Inserting or removing bytes only moves the chunk boundaries close to the edit, all boundaries before and after it stay where they were.
+/// When a modified file is uploaded again, most of its chunks are therefore identical to those of the previous upload.
+/// The boundaries are found with a rolling 'gear' hash over the last 64 bytes, as in FastCDC.
+class ContentChunker
+{
+public:
+    /// The average chunk size for files of up to 48 GB. Larger files use larger chunks, so that they don't need more blocks than a blob can hold.
+    static constexpr int64_t s_minAverageChunkSize = 4 * 1024 * 1024;
+
+    /// Chooses the chunk sizes for a file of the given size.
+    ///
+    /// Uploads of different versions of a file can only share chunks, if the chunk sizes are the same,
+    /// so they only depend on the file size where the block limit requires it.
+    ContentChunker(int64_t fileSize);
+
+    /// Returns the length of the chunk that starts at 'data'. 'length' is how much data is left.
+    int64_t GetChunkLength(const uint8_t* data, int64_t length) const;
+
+private:
+    int64_t m_minChunkSize = 0;
+    int64_t m_maxChunkSize = 0;
+    uint64_t m_boundaryMask = 0;
+};
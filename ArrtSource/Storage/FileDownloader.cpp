@@ -0,0 +1,524 @@
+#include <QCryptographicHash>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <Storage/FileDownloader.h>
+#include <Storage/RetryPolicy.h>
+#include <Storage/StorageAccount.h>
+#include <Storage/WorkerPool.h>
+#include <Utils/Logging.h>
+#include <algorithm>
+#include <map>
+#include <optional>
+
+static constexpr int s_defaultMaxParallelDownloads = 8;
+static constexpr int s_maxParallelDownloadsLimit = 64;
+
+// large blobs are fetched in ranges of this size, small enough to spread one file over all workers, large enough to keep the per-request overhead low
+static constexpr int64_t s_rangeSize = 8 * 1024 * 1024;
+
+// the listing queues the files, and the ranges of files that have already started go before new files, so that only a few files are open at a time
+static constexpr int64_t s_filePriority = 0;
+static constexpr int64_t s_rangePriority = 1;
+static constexpr int64_t s_listingPriority = 2;
+
+// ranges that still fail after the retries of the Storage SDK are downloaded again, with a growing delay in between, see RetryPolicy
+// the budget is per file, so that a file that can't be downloaded at all still fails eventually
+static constexpr int s_maxRangeRetriesPerFile = 10;
+
+// the metadata entry in which the uploader stores the CRC64 of the entire file, as 16 hex characters
+static constexpr const char* s_crc64MetadataKey = "crc64";
+
+/// The state of one file download, shared by all the jobs that download its ranges.
+struct FileDownloader::FileDownload
+{
+    std::shared_ptr<BlobJob> m_job;
+    std::optional<BlobClient> m_blobClient;
+    QString m_blobPath;
+    QString m_localPath;
+    int64_t m_fileSize = 0;
+    Azure::ETag m_etag;
+    QByteArray m_contentMd5;
+    QByteArray m_contentCrc64; ///< Only used to verify the file, if the blob has no Content-MD5.
+
+    QFile m_file;
+    uchar* m_data = nullptr;
+
+    std::atomic<int64_t> m_nextOffset = 0;
+    std::atomic<int> m_activeJobs = 0;
+    std::atomic<int> m_rangeRetries = 0; ///< How many failed ranges were queued again, see s_maxRangeRetriesPerFile.
+    std::atomic<bool> m_failed = false;
+
+    std::mutex m_errorMutex;
+    QString m_errorMsg;
+
+    std::mutex m_crc64Mutex;
+    std::map<int64_t, Crc64Hash> m_rangeCrc64; ///< The checksums of the downloaded ranges, by offset. Only computed when m_contentCrc64 is used.
+
+    QElapsedTimer m_timer;
+
+    /// Splits off the next range of the blob that nobody downloads yet.
+    ///
+    /// Returns false, once the entire blob has been taken.
+    bool TakeNextRange(int64_t& outOffset, int64_t& outLength)
+    {
+        outOffset = m_nextOffset.fetch_add(s_rangeSize);
+
+        if (outOffset >= m_fileSize)
+            return false;
+
+        outLength = std::min(s_rangeSize, m_fileSize - outOffset);
+        return true;
+    }
+
+    void SetFailed(const QString& errorMsg)
+    {
+        std::lock_guard<std::mutex> lock(m_errorMutex);
+
+        // only the first error is interesting, all following ranges are aborted because of it
+        if (!m_failed)
+        {
+            m_errorMsg = errorMsg;
+            m_failed = true;
+        }
+    }
+};
+
+/// One range of a file download, kept while it waits to be downloaded again.
+struct FileDownloader::FileRange
+{
+    int64_t m_offset = 0;
+    int64_t m_length = 0;
+    int m_failedAttempts = 0; ///< How often downloading this range failed already.
+};
+
+FileDownloader::FileDownloader(StorageAccount* storageAccount)
+    : m_storageAccount(storageAccount)
+{
+    m_workerPool = std::make_unique<WorkerPool>(s_defaultMaxParallelDownloads);
+}
+
+FileDownloader::~FileDownloader()
+{
+    // the pool would drop the queued and parked jobs, so the files they belong to would never be finished
+    // cancelled files are deleted when they finish, a preallocated file with missing data would look like a valid one
+    CancelAllDownloads(true);
+
+    m_workerPool.reset();
+}
+
+void FileDownloader::SetMaxParallelDownloads(int maxDownloads)
+{
+    m_workerPool->SetMaxWorkers(std::clamp(maxDownloads, 1, s_maxParallelDownloadsLimit));
+}
+
+int FileDownloader::GetMaxParallelDownloads() const
+{
+    return m_workerPool->GetMaxWorkers();
+}
+
+std::shared_ptr<BlobJob> FileDownloader::DownloadItemAsync(const QString& containerName, const QString& path, const QString& localDirectory, BlobJob::ProgressCallback progressCallback)
+{
+    auto job = std::make_shared<BlobJob>(std::move(progressCallback));
+
+    if (m_storageAccount->GetConnectionStatus() != StorageConnectionStatus::Authenticated || path.isEmpty() || localDirectory.isEmpty())
+    {
+        job->FinishListing(false);
+        return job;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+
+        m_jobs.erase(std::remove_if(m_jobs.begin(), m_jobs.end(), [](const std::weak_ptr<BlobJob>& existing)
+                                    { return existing.expired(); }),
+                     m_jobs.end());
+
+        m_jobs.push_back(job);
+    }
+
+    // the downloaded item keeps its name, so everything is relative to the parent folder
+    const bool isFolder = path.endsWith("/");
+    const QString itemPath = isFolder ? path.chopped(1) : path;
+    const QString parentPath = itemPath.left(itemPath.lastIndexOf("/") + 1);
+    const QString localRoot = QDir(localDirectory).absolutePath();
+
+    m_workerPool->AddJob(s_listingPriority, [this, container = m_storageAccount->GetStorageContainerFromName(containerName), containerName, path, isFolder, parentPath, localRoot, job]()
+                         {
+                             std::vector<std::shared_ptr<FileDownload>> downloads;
+                             QStringList failures;
+
+                             auto addFile = [&](const std::string& blobName, int64_t size, const Azure::ETag& etag, const ContentHash& contentHash, const Azure::Storage::Metadata& metadata)
+                             {
+                                 const QString blobPath = QString::fromStdString(blobName);
+                                 const QString localPath = QDir::cleanPath(localRoot + "/" + blobPath.mid(parentPath.length()));
+
+                                 // blob names may contain '..', which must not end up outside of the chosen directory
+                                 if (!localPath.startsWith(localRoot + "/"))
+                                 {
+                                     failures.append(QString("%1: The path leads outside of the download directory.").arg(blobPath));
+                                     return;
+                                 }
+
+                                 // only the folder is recreated, the dummy file itself isn't needed locally
+                                 if (blobPath.endsWith(".EmptyFolderDummy"))
+                                 {
+                                     QDir().mkpath(QFileInfo(localPath).absolutePath());
+                                     return;
+                                 }
+
+                                 auto download = std::make_shared<FileDownload>();
+                                 download->m_job = job;
+                                 download->m_blobClient = container.GetBlobClient(blobName);
+                                 download->m_blobPath = blobPath;
+                                 download->m_localPath = localPath;
+                                 download->m_fileSize = size;
+                                 download->m_etag = etag;
+
+                                 if (contentHash.Algorithm == HashAlgorithm::Md5)
+                                 {
+                                     download->m_contentMd5 = QByteArray(reinterpret_cast<const char*>(contentHash.Value.data()), (qsizetype)contentHash.Value.size());
+                                 }
+
+                                 // files uploaded in blocks don't always get a Content-MD5, but the uploader stores the CRC64 of the entire file
+                                 auto crc64 = metadata.find(s_crc64MetadataKey);
+                                 if (crc64 != metadata.end())
+                                 {
+                                     download->m_contentCrc64 = QByteArray::fromHex(QByteArray::fromStdString(crc64->second));
+                                 }
+
+                                 downloads.push_back(std::move(download));
+                             };
+
+                             auto queueFiles = [&]()
+                             {
+                                 int64_t numBytes = 0;
+                                 for (const auto& download : downloads)
+                                 {
+                                     numBytes += download->m_fileSize;
+                                 }
+
+                                 // rejected blobs count as one task each, which is finished right away
+                                 job->AddFoundBlobs((int64_t)(downloads.size() + failures.size()), numBytes, (int)(downloads.size() + failures.size()));
+
+                                 for (const QString& failure : failures)
+                                 {
+                                     job->FinishTask(0, 0, {failure});
+                                 }
+
+                                 for (const auto& download : downloads)
+                                 {
+                                     m_workerPool->AddJob(s_filePriority, [this, download]()
+                                                          { StartFileDownload(download); });
+                                 }
+
+                                 downloads.clear();
+                                 failures.clear();
+                             };
+
+                             bool success = true;
+
+                             try
+                             {
+                                 if (!isFolder)
+                                 {
+                                     auto properties = container.GetBlobClient(path.toStdString()).GetProperties(GetBlobPropertiesOptions(), job->GetContext());
+
+                                     addFile(path.toStdString(), properties.Value.BlobSize, properties.Value.ETag, properties.Value.HttpHeaders.ContentHash, properties.Value.Metadata);
+                                     queueFiles();
+                                 }
+                                 else
+                                 {
+                                     ListBlobsOptions opt;
+                                     opt.Prefix = path.toStdString();
+                                     opt.Include = Models::ListBlobsIncludeFlags::Metadata;
+
+                                     // the files of every page start downloading while the next page is listed
+                                     for (auto page = container.ListBlobs(opt, job->GetContext()); page.HasPage() && !job->IsCancelled(); page.MoveToNextPage(job->GetContext()))
+                                     {
+                                         for (const auto& blob : page.Blobs)
+                                         {
+                                             addFile(blob.Name, blob.BlobSize, blob.Details.ETag, blob.Details.HttpHeaders.ContentHash, blob.Details.Metadata);
+                                         }
+
+                                         queueFiles();
+                                     }
+                                 }
+                             }
+                             catch (const std::exception& e)
+                             {
+                                 success = job->IsCancelled();
+
+                                 if (!success)
+                                 {
+                                     qWarning(LoggingCategory::AzureStorage)
+                                         << "Listing items for downloading failed."
+                                         << "\n  Container: " << containerName
+                                         << "\n  Path: " << path
+                                         << "\n  Msg: " << e.what();
+                                 }
+                             }
+
+                             job->FinishListing(success); });
+
+    return job;
+}
+
+void FileDownloader::CancelAllDownloads(bool waitForCompletion)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+
+        for (const auto& weakJob : m_jobs)
+        {
+            if (auto job = weakJob.lock())
+            {
+                job->Cancel();
+            }
+        }
+
+        m_jobs.clear();
+    }
+
+    if (waitForCompletion)
+    {
+        // the cancelled work still runs once to close its files, but it doesn't send any more requests
+        // ranges that wait for a retry don't have to wait for their delay anymore
+        m_workerPool->RunDelayedJobsNow();
+        m_workerPool->WaitUntilIdle();
+    }
+}
+
+// preallocates the local file and queues a job for every range of it
+void FileDownloader::StartFileDownload(const std::shared_ptr<FileDownload>& download)
+{
+    if (download->m_job->IsCancelled())
+    {
+        FinishFileDownload(download);
+        return;
+    }
+
+    download->m_timer.start();
+
+    download->m_file.setFileName(download->m_localPath);
+
+    // the file gets its final size right away, so the file system can allocate it in one piece, and the ranges can be written in any order
+    if (!QDir().mkpath(QFileInfo(download->m_localPath).absolutePath()) || !download->m_file.open(QIODevice::ReadWrite | QIODevice::Truncate) || !download->m_file.resize(download->m_fileSize))
+    {
+        download->SetFailed(QString("Failed to create the local file: %1").arg(download->m_file.errorString()));
+        FinishFileDownload(download);
+        return;
+    }
+
+    if (download->m_fileSize == 0)
+    {
+        FinishFileDownload(download);
+        return;
+    }
+
+    // the ranges are downloaded straight into a mapping of the file, without extra copies or write calls
+    download->m_data = download->m_file.map(0, download->m_fileSize);
+    if (download->m_data == nullptr)
+    {
+        download->SetFailed(QString("Failed to map the local file: %1").arg(download->m_file.errorString()));
+        FinishFileDownload(download);
+        return;
+    }
+
+    // every range is a separate job, so that idle workers can help with large files
+    // each job queues the next one when it is done, as long as there are ranges left, so the number of parallel jobs per file stays the same
+    const int64_t numRanges = (download->m_fileSize + s_rangeSize - 1) / s_rangeSize;
+    const int numJobs = (int)std::clamp<int64_t>(numRanges, 1, GetMaxParallelDownloads());
+
+    download->m_activeJobs = numJobs;
+
+    for (int i = 1; i < numJobs; ++i)
+    {
+        m_workerPool->AddJob(s_rangePriority, [this, download]()
+                             { DownloadNextRange(download, nullptr); });
+    }
+
+    // this worker does the first range itself
+    DownloadNextRange(download, nullptr);
+}
+
+void FileDownloader::DownloadNextRange(const std::shared_ptr<FileDownload>& download, std::shared_ptr<FileRange> range)
+{
+    // a range that failed before is downloaded again, otherwise the next one is taken
+    if (!range && !download->m_failed && !download->m_job->IsCancelled())
+    {
+        range = std::make_shared<FileRange>();
+
+        if (!download->TakeNextRange(range->m_offset, range->m_length))
+        {
+            range.reset();
+        }
+    }
+
+    if (!range || download->m_failed || download->m_job->IsCancelled())
+    {
+        // whoever ends the last job, finishes the file
+        if (download->m_activeJobs.fetch_sub(1) == 1)
+        {
+            FinishFileDownload(download);
+        }
+
+        return;
+    }
+
+    const int64_t offset = range->m_offset;
+    const int64_t length = range->m_length;
+
+    try
+    {
+        DownloadBlobToOptions opt;
+        opt.Range = Azure::Core::Http::HttpRange{offset, length};
+
+        // all ranges must come from the same version of the blob, otherwise the file would be a mix of old and new data
+        opt.AccessConditions.IfMatch = download->m_etag;
+
+        // the ranges of a file are already downloaded in parallel, the SDK shouldn't split them up any further
+        opt.TransferOptions.Concurrency = 1;
+
+        download->m_blobClient->DownloadTo(download->m_data + offset, (size_t)length, opt, download->m_job->GetContext());
+
+        // the checksum of a range is computed right away, while its data is still in the cache, and the ranges are combined once the file is complete
+        if (download->m_contentMd5.isEmpty() && !download->m_contentCrc64.isEmpty())
+        {
+            Crc64Hash crc64;
+            crc64.Append(download->m_data + offset, (size_t)length);
+
+            std::lock_guard<std::mutex> lock(download->m_crc64Mutex);
+            download->m_rangeCrc64[offset].Concatenate(crc64);
+        }
+
+        download->m_job->AddTransferredBytes(length);
+    }
+    catch (const std::exception& e)
+    {
+        // only this range is downloaded again, into the same place of the file, the ranges that are done stay as they are
+        if (!download->m_job->IsCancelled() && RetryPolicy::IsTransientError(e) && download->m_rangeRetries.fetch_add(1) < s_maxRangeRetriesPerFile)
+        {
+            range->m_failedAttempts++;
+
+            qWarning(LoggingCategory::AzureStorage)
+                << "Range download failed, retrying."
+                << "\n  Src: " << download->m_blobPath
+                << "\n  Offset: " << offset
+                << "\n  Attempt: " << range->m_failedAttempts
+                << "\n  Reason: " << e.what();
+
+            // the range is parked outside of the queue, so it doesn't hold a worker while it waits
+            m_workerPool->AddDelayedJob(RetryPolicy::GetRetryDelay(range->m_failedAttempts), s_rangePriority, [this, download, range]()
+                                        { DownloadNextRange(download, range); });
+
+            // a cancellation that came in between has to find the range in the queue, so that it can finish right away
+            if (download->m_job->IsCancelled())
+            {
+                m_workerPool->RunDelayedJobsNow();
+            }
+
+            return;
+        }
+
+        download->SetFailed(e.what());
+    }
+
+    m_workerPool->AddJob(s_rangePriority, [this, download]()
+                         { DownloadNextRange(download, nullptr); });
+}
+
+void FileDownloader::FinishFileDownload(const std::shared_ptr<FileDownload>& download)
+{
+    const bool cancelled = download->m_job->IsCancelled();
+
+    // the mapping still holds the data, so verifying the file doesn't read it back from disk
+    if (!cancelled && !download->m_failed && !download->m_contentMd5.isEmpty())
+    {
+        QCryptographicHash hash(QCryptographicHash::Md5);
+
+        if (download->m_data != nullptr)
+        {
+            hash.addData(QByteArray::fromRawData(reinterpret_cast<const char*>(download->m_data), (qsizetype)download->m_fileSize));
+        }
+
+        if (hash.result() != download->m_contentMd5)
+        {
+            download->SetFailed("The downloaded data doesn't match the Content-MD5 of the blob.");
+        }
+    }
+    else if (!cancelled && !download->m_failed && !download->m_contentCrc64.isEmpty())
+    {
+        // all ranges are done at this point, the map has them in the order of the file
+        Crc64Hash hash;
+        for (const auto& range : download->m_rangeCrc64)
+        {
+            hash.Concatenate(range.second);
+        }
+
+        const std::vector<uint8_t> crc64 = hash.Final();
+
+        if (QByteArray(reinterpret_cast<const char*>(crc64.data()), (qsizetype)crc64.size()) != download->m_contentCrc64)
+        {
+            download->SetFailed("The downloaded data doesn't match the CRC64 of the blob.");
+        }
+    }
+
+    if (download->m_data != nullptr)
+    {
+        download->m_file.unmap(download->m_data);
+        download->m_data = nullptr;
+    }
+
+    // an incomplete file would look like a valid one, so it is better to not have it at all
+    if (download->m_file.isOpen() && (cancelled || download->m_failed))
+    {
+        download->m_file.remove();
+    }
+
+    download->m_file.close();
+
+    QStringList failures;
+
+    if (cancelled)
+    {
+        qInfo(LoggingCategory::AzureStorage)
+            << "File download cancelled."
+            << "\n  Src: " << download->m_blobPath
+            << "\n  Dst: " << download->m_localPath;
+    }
+    else if (!download->m_failed)
+    {
+        if (download->m_contentMd5.isEmpty() && download->m_contentCrc64.isEmpty())
+        {
+            qWarning(LoggingCategory::AzureStorage)
+                << "The downloaded file could not be verified, the blob has neither a Content-MD5 nor a CRC64."
+                << "\n  Src: " << download->m_blobPath
+                << "\n  Dst: " << download->m_localPath;
+        }
+
+        const double seconds = std::max<qint64>(1, download->m_timer.elapsed()) / 1000.0;
+
+        qInfo(LoggingCategory::AzureStorage)
+            << "File download finished."
+            << "\n  Src: " << download->m_blobPath
+            << "\n  Dst: " << download->m_localPath
+            << "\n  Speed: " << QString("%1 MB/s").arg((download->m_fileSize / (1024.0 * 1024.0)) / seconds, 0, 'f', 2);
+
+        download->m_job->FinishTask(1, download->m_fileSize, failures);
+        return;
+    }
+    else
+    {
+        qCritical(LoggingCategory::AzureStorage)
+            << "File download failed."
+            << "\n  Src: " << download->m_blobPath
+            << "\n  Dst: " << download->m_localPath
+            << "\n  Msg: " << download->m_errorMsg;
+
+        failures.append(QString("%1: %2").arg(download->m_blobPath).arg(download->m_errorMsg));
+    }
+
+    download->m_job->FinishTask(0, 0, failures);
+}
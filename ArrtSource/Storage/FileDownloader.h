@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QString>
+#include <Storage/BlobJob.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class StorageAccount;
+class WorkerPool;
+
+/// Used to download files and folders from Azure Storage asynchronously.
+///
+/// All downloads share one pool of worker threads. Large blobs are split into ranges, which are downloaded as separate jobs,
+/// so that a single huge file and many small ones both keep all connections busy.
+/// Every file is preallocated at its final size and the ranges are written straight into a mapping of it.
+class FileDownloader
+{
+public:
+    FileDownloader(StorageAccount* storageAccount);
+
+    /// Cancels all downloads, deletes the incomplete local files and waits until the worker threads have stopped.
+    ~FileDownloader();
+
+    /// Sets how many files and ranges are downloaded in parallel.
+    void SetMaxParallelDownloads(int maxDownloads);
+
+    /// Returns how many files and ranges are downloaded in parallel.
+    int GetMaxParallelDownloads() const;
+
+    /// Downloads a file or folder into a local directory in the background.
+    ///
+    /// If 'path' is a folder (ends with a slash), the folder is created inside 'localDirectory' and all files inside it are downloaded with their relative paths.
+    /// Otherwise only the file is downloaded into 'localDirectory'. Existing local files are overwritten.
+    /// Files that have a Content-MD5 property are verified after the download, files that don't match are deleted again and reported as failed.
+    /// Files without one are verified with the CRC64 that the uploader stores in the metadata of the blob, if there is one.
+    /// Ranges that fail with a transient error are downloaded again after a delay, only the ranges, not the entire file.
+    /// The progress reports the downloaded bytes whenever a range is done, see BlobJobProgress::m_transferredBytes.
+    /// 'progressCallback' is called on a background thread, the last call has BlobJobProgress::m_finished set.
+    std::shared_ptr<BlobJob> DownloadItemAsync(const QString& containerName, const QString& path, const QString& localDirectory, BlobJob::ProgressCallback progressCallback);
+
+    /// Cancels all download jobs.
+    ///
+    /// If waitForCompletion is true, this blocks until all workers have stopped working on the cancelled jobs.
+    /// That is necessary before the storage account connection is changed, since the workers access it.
+    void CancelAllDownloads(bool waitForCompletion);
+
+private:
+    struct FileDownload;
+    struct FileRange;
+
+    void StartFileDownload(const std::shared_ptr<FileDownload>& download);
+    void DownloadNextRange(const std::shared_ptr<FileDownload>& download, std::shared_ptr<FileRange> range);
+    void FinishFileDownload(const std::shared_ptr<FileDownload>& download);
+
+    std::mutex m_jobsMutex;
+    std::vector<std::weak_ptr<BlobJob>> m_jobs;
+
+    StorageAccount* m_storageAccount = nullptr;
+
+    // declared last, so that the workers are stopped before anything they use gets destroyed
+    std::unique_ptr<WorkerPool> m_workerPool;
+};
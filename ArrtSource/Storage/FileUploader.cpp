@@ -1,148 +1,726 @@
-#include <QApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QSettings>
 #include <QStringList>
-#include <QUuid>
+#include <QTimer>
+#include <Storage/ContentChunker.h>
 #include <Storage/FileUploader.h>
 #include <Storage/IncludeAzureStorage.h>
+#include <Storage/RetryPolicy.h>
 #include <Storage/StorageAccount.h>
+#include <Storage/UploadJournal.h>
+#include <Storage/WorkerPool.h>
 #include <Utils/Logging.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <future>
+#include <optional>
+#include <set>
+
+static constexpr int s_defaultMaxParallelUploads = 8;
+static constexpr int s_maxParallelUploadsLimit = 64;
+
+// reading folders mostly waits for the file system, a few scans in parallel help with network shares and deep folder trees
+static constexpr int s_maxParallelFolderScans = 4;
+
+// reading ahead only helps while few reads run at the same time, more would make the disk seek back and forth between files
+static constexpr int s_maxParallelReads = 4;
+
+// blocks that still fail after the retries of the Storage SDK are queued again, with a growing delay in between, see RetryPolicy
+// the budget is per file, so that a file that can't be uploaded at all still fails eventually
+static constexpr int s_maxBlockRetriesPerFile = 10;
+
+// the metadata entry that holds the CRC64 of the entire file, as 16 hex characters
+static constexpr const char* s_crc64MetadataKey = "crc64";
+
+// how often the progress is reported while uploads are running
+static constexpr std::chrono::milliseconds s_progressInterval(100);
+
+/// A read-only memory mapping of an entire file.
+///
+/// Delta uploads split the entire file into chunks before anything is uploaded, and afterwards the chunks are sent straight from the same mapping,
+/// since the data is most likely still in the page cache.
+class MappedFile
+{
+public:
+    MappedFile(const QString& path)
+        : m_file(path)
+    {
+        if (m_file.open(QIODevice::OpenModeFlag::ReadOnly) && m_file.size() > 0)
+        {
+            m_data = m_file.map(0, m_file.size());
+        }
+    }
+
+    ~MappedFile()
+    {
+        if (m_data != nullptr)
+        {
+            m_file.unmap(m_data);
+        }
+    }
+
+    bool IsValid() const
+    {
+        return m_data != nullptr;
+    }
+
+    const uint8_t* GetData(int64_t offset) const
+    {
+        return m_data + offset;
+    }
+
+private:
+    QFile m_file;
+    uchar* m_data = nullptr;
+};
+
+// creates a random value that makes the block IDs of one upload different from those of all other uploads
+static QString CreateBlockIdNonce()
+{
+    // 96 random bits as hex, leaves room for a 32 bit block index
+    QRandomGenerator* rng = QRandomGenerator::global();
+    return QString("%1%2").arg(rng->generate64(), 16, 16, QChar('0')).arg(rng->generate(), 8, 16, QChar('0'));
+}
+
+// creates the name for the block with the given index
+static std::string CreateBlockId(const QString& nonce, int64_t blockIdx)
+{
+    // all block IDs of a blob must have the same length, including stale uncommitted blocks from earlier uploads
+    // 32 hex characters are what previous ARRT versions used (GUIDs without dashes), and hex digits are also valid Base64
+    return QString("%1%2").arg(nonce).arg(blockIdx, 8, 16, QChar('0')).toStdString();
+}
+
+/// The state of one file upload, shared by all the jobs that upload its blocks.
+struct FileUploader::FileUpload
+{
+    std::shared_ptr<UploadJob> m_job;
+    QString m_sourceFilePath;
+    QString m_containerName;
+    QString m_blobPath;
+    int64_t m_fileSize = 0;
+    int64_t m_lastModified = 0;
+    int64_t m_blockSize = 0;
+    std::optional<BlockBlobClient> m_blobClient;
+    QByteArray m_contentMd5;
+    std::unique_ptr<MappedFile> m_mappedFile;
+
+    bool m_resume = false;
+    QString m_journalPath;
+    UploadJournal m_journal;
+
+    // the blocks are planned while the upload progresses, since their size depends on how fast the previous blocks were
+    std::mutex m_planMutex;
+    std::vector<UploadBlock> m_blocks;             ///< All blocks that are staged or scheduled for staging.
+    std::deque<UploadBlock> m_plannedBlocks;       ///< Blocks whose boundaries are known in advance (delta uploads), but that aren't scheduled yet.
+    std::deque<std::pair<int64_t, int64_t>> m_gaps; ///< Byte ranges [start; end) that aren't covered by blocks yet.
+    std::map<int64_t, Crc64Hash> m_blockCrc64;     ///< The checksums of the blocks whose data was read in this upload, by offset.
+    int64_t m_unscheduledBytes = 0;
+    QString m_blockIdNonce;
+
+    // the MD5 hash of the file is computed from the staged blocks, but they finish in any order, so every block waits until the data before it is hashed
+    std::mutex m_hashMutex;
+    bool m_hashWhileStaging = false;
+    bool m_hashing = false;    ///< Set while one job adds blocks to the hash, the other jobs only queue theirs.
+    bool m_hashFailed = false; ///< Set if a block couldn't be read again, the blob won't get a Content-MD5 then.
+    int64_t m_hashedBytes = 0;
+    std::map<int64_t, std::pair<UploadBlock, BlockBuffer>> m_unhashedBlocks; ///< Staged blocks that aren't hashed yet, by offset, with their data, unless it has to be read again.
+    QCryptographicHash m_md5{QCryptographicHash::Md5};
+
+    std::atomic<int> m_activeJobs = 0;
+    std::atomic<int> m_blockRetries = 0; ///< How many failed blocks were queued again, see s_maxBlockRetriesPerFile.
+    std::atomic<bool> m_failed = false;
+
+    std::mutex m_errorMutex;
+    QString m_errorMsg;
+
+    QElapsedTimer m_timer;
+    std::atomic<int64_t> m_uploadedBytes = 0;
+
+    /// Splits off the next block from the parts of the file that haven't been scheduled yet.
+    ///
+    /// Returns false, once the entire file has been scheduled.
+    bool TakeNextBlock(const BlockSizePolicy& policy, UploadBlock& outBlock)
+    {
+        std::lock_guard<std::mutex> lock(m_planMutex);
+
+        if (!m_plannedBlocks.empty())
+        {
+            outBlock = m_plannedBlocks.front();
+            m_plannedBlocks.pop_front();
+            m_unscheduledBytes -= outBlock.m_size;
+
+            m_blocks.push_back(outBlock);
+            return true;
+        }
+
+        while (!m_gaps.empty() && m_gaps.front().first >= m_gaps.front().second)
+        {
+            m_gaps.pop_front();
+        }
+
+        if (m_gaps.empty())
+            return false;
+
+        auto& gap = m_gaps.front();
+
+        const int64_t blockSize = policy.GetBlockSize(m_fileSize, m_unscheduledBytes, BlockSizePolicy::s_maxBlocksPerBlob - (int64_t)m_blocks.size());
+
+        outBlock.m_id = CreateBlockId(m_blockIdNonce, (int64_t)m_blocks.size());
+        outBlock.m_offset = gap.first;
+        outBlock.m_size = std::min(blockSize, gap.second - gap.first);
+
+        gap.first += outBlock.m_size;
+        m_unscheduledBytes -= outBlock.m_size;
+
+        m_blocks.push_back(outBlock);
+        return true;
+    }
+
+    void SetFailed(const QString& errorMsg)
+    {
+        std::lock_guard<std::mutex> lock(m_errorMutex);
+
+        // only the first error is interesting, all following blocks are aborted because of it
+        if (!m_failed)
+        {
+            m_errorMsg = errorMsg;
+            m_failed = true;
+        }
+    }
+};
 
 FileUploader::FileUploader(UpdateCallback callback, StorageAccount* storageAccount)
-    : m_remainingFilesCallback(std::move(callback))
+    : m_progressCallback(std::move(callback))
     , m_storageAccount(storageAccount)
 {
+    m_workerPool = std::make_unique<WorkerPool>(s_defaultMaxParallelUploads);
+    m_scanWorkers = std::make_unique<WorkerPool>(s_maxParallelFolderScans);
+    m_readWorkers = std::make_unique<WorkerPool>(s_maxParallelReads);
+
+    m_progressTimer = std::make_unique<QTimer>();
+    m_progressTimer->setInterval(s_progressInterval);
+    QObject::connect(m_progressTimer.get(), &QTimer::timeout, m_progressTimer.get(), [this]()
+                     { SampleProgress(); });
+
+    LoadSettings();
 }
 
-// upload multiple files to a blob storage directory. SourceRootDirectory will map to destDirectory
-void FileUploader::UploadFilesAsync(const QDir& sourceRootDirectory, const QStringList& sourceFilePaths, const QString& containerName, const QString& destDirectory)
+FileUploader::~FileUploader()
 {
-    if (sourceFilePaths.isEmpty())
-        return;
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+
+        // aborts the requests in flight and prevents that any further work gets queued
+        for (const auto& job : m_jobs)
+        {
+            job->Detach();
+        }
+    }
+
+    // waits for the running jobs, before the rest of the uploader goes away
+    // the scans queue uploads, so they have to stop first, and the uploads wait for their reads
+    m_scanWorkers.reset();
+    m_workerPool.reset();
+    m_readWorkers.reset();
+}
+
+void FileUploader::LoadSettings()
+{
+    QSettings s;
+    s.beginGroup("FileUploader");
+    SetMaxParallelUploads(s.value("MaxParallelUploads", s_defaultMaxParallelUploads).toInt());
+    m_resumeUploads = s.value("ResumeUploads", true).toBool();
+    m_blockSizePolicy.SetAdaptive(s.value("AdaptiveBlockSize", true).toBool());
+    m_rateLimiter.SetLimit(s.value("MaxBytesPerSecond", 0).toLongLong());
+    m_skipUnchangedFiles = s.value("SkipUnchangedFiles", false).toBool();
+    m_deltaUploads = s.value("DeltaUploads", false).toBool();
+    s.endGroup();
+}
+
+void FileUploader::SaveSettings() const
+{
+    QSettings s;
+    s.beginGroup("FileUploader");
+    s.setValue("MaxParallelUploads", GetMaxParallelUploads());
+    s.setValue("ResumeUploads", m_resumeUploads);
+    s.setValue("AdaptiveBlockSize", m_blockSizePolicy.IsAdaptive());
+    s.setValue("MaxBytesPerSecond", m_rateLimiter.GetLimit());
+    s.setValue("SkipUnchangedFiles", m_skipUnchangedFiles);
+    s.setValue("DeltaUploads", m_deltaUploads);
+    s.endGroup();
+}
+
+void FileUploader::SetMaxParallelUploads(int maxUploads)
+{
+    const int maxWorkers = std::clamp(maxUploads, 1, s_maxParallelUploadsLimit);
+
+    // every worker may need a buffer for its block beyond the memory budget, when nothing was read ahead for it
+    // with smaller blocks for more workers, these buffers together never take more than the budget
+    m_blockSizePolicy.SetMaxBlockSize(BlockBufferPool::s_memoryBudget / maxWorkers);
+    m_workerPool->SetMaxWorkers(maxWorkers);
+}
+
+int FileUploader::GetMaxParallelUploads() const
+{
+    return m_workerPool->GetMaxWorkers();
+}
+
+// computes the MD5 hash of an entire file, returns an empty array if the file can't be read or the context gets cancelled
+static QByteArray ComputeFileMd5(const QString& filePath, const Azure::Core::Context& context = Azure::Core::Context())
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    QByteArray buffer(4 * 1024 * 1024, Qt::Uninitialized);
+
+    while (!file.atEnd())
+    {
+        // hashing a large file takes a while, so check in between whether the upload was cancelled
+        if (context.IsCancelled())
+            return {};
+
+        const qint64 read = file.read(buffer.data(), buffer.size());
+        if (read < 0)
+            return {};
 
-    if (m_remainingFiles == 0)
+        hash.addData(buffer.left(read));
+    }
+
+    return hash.result();
+}
+
+// returns whether the file exists at the destination with the same size and content
+// if the file had to be hashed for that, the hash is returned in 'outContentMd5', so that the upload doesn't need to compute it again
+static bool IsUnchangedFile(const std::map<QString, StorageBlobInfo>& remoteBlobs, const QString& blobPath, const QFileInfo& fileInfo, QByteArray& outContentMd5)
+{
+    auto it = remoteBlobs.find(blobPath);
+
+    // only hash the file, if the cheap checks can't tell the difference
+    if (it == remoteBlobs.end() || it->second.m_size != fileInfo.size() || it->second.m_contentHash.isEmpty())
+        return false;
+
+    outContentMd5 = ComputeFileMd5(fileInfo.filePath());
+    return it->second.m_contentHash == outContentMd5;
+}
+
+std::shared_ptr<UploadJob> FileUploader::CreateUploadJob()
+{
+    // the scans are checked first, see UploadJob::IsFinished()
+    if (m_pendingScans == 0 && m_remainingFiles == 0)
     {
         // reset to zero, if there are currently no file uploads running
         m_bytesRead = 0;
         m_totalBytesToRead = 0;
+        m_finishedFiles = 0;
+        m_failedFiles = 0;
+        m_cancelledFiles = 0;
+        m_skippedFiles = 0;
+        m_skippedBytes = 0;
+        m_retriedBlocks = 0;
+        m_waitingRetries = 0;
+
+        m_lastSampleTime = std::chrono::steady_clock::now();
+        m_lastSampledBytes = 0;
+        m_smoothedBytesPerSecond = 0.0;
     }
 
-    // add up all the remaining bytes to upload
-    for (const QString& file : sourceFilePaths)
+    auto job = std::make_shared<UploadJob>(m_workerPool.get());
+
     {
-        QFileInfo fi(file);
-        m_totalBytesToRead.fetch_add(fi.size());
-    }
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
 
-    const int64_t read = m_bytesRead;
-    const int64_t total = m_totalBytesToRead;
-    const float percentage = (total > 0) ? (double)read / (double)total : 1.0;
+        m_jobs.erase(std::remove_if(m_jobs.begin(), m_jobs.end(), [](const auto& existing)
+                                    { return existing->IsFinished(); }),
+                     m_jobs.end());
+
+        m_jobs.push_back(job);
+    }
 
-    const int toUpload = sourceFilePaths.size();
-    const int remainingFiles = m_remainingFiles.fetch_add(toUpload) + toUpload;
-    QMetaObject::invokeMethod(QApplication::instance(), [this, remainingFiles, percentage]()
-                              { m_remainingFilesCallback(remainingFiles, percentage); });
+    return job;
+}
 
+std::shared_ptr<FileUploader::FileUpload> FileUploader::CreateFileUpload(const std::shared_ptr<UploadJob>& job, const QFileInfo& fileInfo, const QString& accountName, const QString& containerName, const QString& blobPath, const QByteArray& contentMd5) const
+{
+    auto upload = std::make_shared<FileUpload>();
+    upload->m_job = job;
+    upload->m_sourceFilePath = fileInfo.filePath();
+    upload->m_containerName = containerName;
+    upload->m_blobPath = blobPath;
+    upload->m_fileSize = fileInfo.size();
+    upload->m_lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+    upload->m_contentMd5 = contentMd5;
 
-    auto asyncCallback = [sourceRootDirectory, sourceFilePaths, containerName, destDirectory, this](int from, int to)
+    if (m_resumeUploads)
     {
-        for (int i = from; i < to; ++i)
-        {
-            UploadFileInternalSync(sourceRootDirectory, sourceFilePaths[i], containerName, destDirectory);
-        }
-    };
+        upload->m_resume = true;
+        upload->m_journalPath = UploadJournal::GetJournalPath(accountName, containerName, upload->m_blobPath);
+    }
 
-    // if there are multiple files, upload them in parallel
-    static const int max_threads = 4;
-    int numThreads = 0;
-    int batchSize = 0;
+    return upload;
+}
 
-    if (sourceFilePaths.count() <= max_threads)
+void FileUploader::ScheduleFileUploads(UploadJob& job, const std::vector<std::shared_ptr<FileUpload>>& uploads)
+{
+    int64_t totalBytes = 0;
+    for (const auto& upload : uploads)
     {
-        numThreads = sourceFilePaths.count();
-        batchSize = 1;
+        totalBytes += upload->m_fileSize;
     }
-    else
+
+    // everything is counted before the first file is scheduled, so that the job can't finish in between
+    m_totalBytesToRead.fetch_add(totalBytes);
+    job.m_remainingFiles.fetch_add((int)uploads.size());
+    m_remainingFiles.fetch_add((int)uploads.size());
+
+    // the worker pool picks the largest files first
+    for (const auto& upload : uploads)
     {
-        numThreads = max_threads;
-        batchSize = sourceFilePaths.count() / numThreads;
+        job.Schedule(upload->m_fileSize, [this, upload]()
+                     { StartFileUpload(upload); });
     }
+}
+
+// upload multiple files to a blob storage directory. SourceRootDirectory will map to destDirectory
+std::shared_ptr<UploadJob> FileUploader::UploadFilesAsync(const QDir& sourceRootDirectory, const QStringList& sourceFilePaths, const QString& containerName, const QString& destDirectory)
+{
+    if (sourceFilePaths.isEmpty())
+        return nullptr;
+
+    auto job = CreateUploadJob();
+    const QString accountName = m_storageAccount->GetAccountName();
 
-    int batchStart = 0;
+    std::vector<std::shared_ptr<FileUpload>> uploads;
+    uploads.reserve(sourceFilePaths.size());
 
-    for (int i = 0; i < numThreads - 1; ++i)
+    for (const QString& file : sourceFilePaths)
     {
-        std::thread(std::bind(asyncCallback, batchStart, batchStart + batchSize)).detach();
-        batchStart += batchSize;
+        uploads.push_back(CreateFileUpload(job, QFileInfo(file), accountName, containerName, destDirectory + sourceRootDirectory.relativeFilePath(file)));
     }
 
-    std::thread(std::bind(asyncCallback, batchStart, sourceFilePaths.count())).detach();
+    ScheduleFileUploads(*job, uploads);
+
+    SampleProgress();
+    m_progressTimer->start();
+
+    return job;
 }
 
-void FileUploader::NotifyBytesRead(int64_t bytes)
+/// The state of one call to UploadPathsAsync(), shared by all the jobs that scan its folders.
+struct FileUploader::FolderScan
 {
-    m_bytesRead.fetch_add(bytes);
+    std::shared_ptr<UploadJob> m_job;
+    QDir m_sourceRootDirectory;
+    QString m_accountName;
+    QString m_containerName;
+    QString m_destDirectory;
+
+    // filled in before any folder is scanned, and only read afterwards
+    bool m_skipUnchangedFiles = false;
+    std::map<QString, StorageBlobInfo> m_remoteBlobs;
+};
+
+std::shared_ptr<UploadJob> FileUploader::UploadPathsAsync(const QDir& sourceRootDirectory, const QStringList& sourcePaths, const QString& containerName, const QString& destDirectory)
+{
+    if (sourcePaths.isEmpty())
+        return nullptr;
 
-    const int remainingFiles = m_remainingFiles;
+    auto scan = std::make_shared<FolderScan>();
+    scan->m_job = CreateUploadJob();
+    scan->m_sourceRootDirectory = sourceRootDirectory;
+    scan->m_accountName = m_storageAccount->GetAccountName();
+    scan->m_containerName = containerName;
+    scan->m_destDirectory = destDirectory;
+    scan->m_skipUnchangedFiles = m_skipUnchangedFiles;
 
-    const int64_t read = m_bytesRead;
-    const int64_t total = m_totalBytesToRead;
-    const float percentage = (total > 0) ? (double)read / (double)total : 1.0;
+    // the first scan lists the destination, if necessary, and then queues the given files and a scan for every given folder
+    scan->m_job->m_pendingScans.fetch_add(1);
+    m_pendingScans.fetch_add(1);
 
-    QMetaObject::invokeMethod(QApplication::instance(), [this, remainingFiles, percentage]()
-                              { m_remainingFilesCallback(remainingFiles, percentage); });
+    m_scanWorkers->AddJob(0, [this, scan, sourcePaths]()
+                          { StartFolderScan(scan, sourcePaths); });
+
+    SampleProgress();
+    m_progressTimer->start();
+
+    return scan->m_job;
 }
 
-constexpr int64_t GetMB(int64_t bytes)
+void FileUploader::StartFolderScan(const std::shared_ptr<FolderScan>& scan, const QStringList& sourcePaths)
 {
-    return 1024i64 * 1024i64 * bytes;
+    if (scan->m_skipUnchangedFiles && !scan->m_job->IsCancelled())
+    {
+        // one flat listing of the destination folder is much cheaper than querying the properties of every blob
+        const bool listed = m_storageAccount->ListBlobsRecursive(scan->m_containerName, scan->m_destDirectory, [&scan](const std::vector<StorageBlobInfo>&, const std::vector<StorageBlobInfo>& files, const QString&)
+                                                                 {
+                                                                     for (const StorageBlobInfo& file : files)
+                                                                     {
+                                                                         scan->m_remoteBlobs[file.m_path] = file;
+                                                                     }
+
+                                                                     return !scan->m_job->IsCancelled(); });
+
+        if (!listed)
+        {
+            qWarning(LoggingCategory::AzureStorage) << "Listing the upload destination failed, all files will be uploaded.";
+            scan->m_skipUnchangedFiles = false;
+        }
+    }
+
+    QFileInfoList files;
+    QStringList folders;
+
+    for (const QString& path : sourcePaths)
+    {
+        const QFileInfo fileInfo(path);
+
+        if (fileInfo.isDir())
+        {
+            folders.append(path);
+        }
+        else if (fileInfo.exists())
+        {
+            files.append(fileInfo);
+        }
+    }
+
+    ScanFolderEntries(scan, files, folders);
 }
-constexpr int64_t GetGB(int64_t bytes)
+
+void FileUploader::ScanFolder(const std::shared_ptr<FolderScan>& scan, const QString& folderPath)
 {
-    return 1024i64 * 1024i64 * 1024i64 * bytes;
+    QFileInfoList files;
+    QStringList folders;
+
+    if (!scan->m_job->IsCancelled())
+    {
+        // the file infos already hold the size and modification time, so the files don't need to be looked at again
+        for (const QFileInfo& entry : QDir(folderPath).entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot))
+        {
+            if (!entry.isDir())
+            {
+                files.append(entry);
+            }
+            else if (!entry.isSymLink())
+            {
+                // linked folders could lead into cycles, and they were never followed before either
+                folders.append(entry.filePath());
+            }
+        }
+    }
+
+    ScanFolderEntries(scan, files, folders);
 }
 
-class FileStream : public Azure::Core::IO::BodyStream
+void FileUploader::ScanFolderEntries(const std::shared_ptr<FolderScan>& scan, const QList<QFileInfo>& files, const QStringList& folders)
 {
-public:
-    FileStream(const std::string& path)
-        : m_file(path.c_str())
+    UploadJob& job = *scan->m_job;
+
+    // every sub-folder is scanned separately, so that idle scan workers can help with deep and wide folder trees
+    if (!job.IsCancelled())
     {
-        if (m_file.open(QIODevice::OpenModeFlag::ReadOnly))
+        for (const QString& folder : folders)
         {
-            m_size = m_file.size();
+            job.m_pendingScans.fetch_add(1);
+            m_pendingScans.fetch_add(1);
+
+            m_scanWorkers->AddJob(0, [this, scan, folder]()
+                                  { ScanFolder(scan, folder); });
         }
+    }
+
+    std::vector<std::shared_ptr<FileUpload>> uploads;
+    uploads.reserve(files.size());
+
+    for (const QFileInfo& fileInfo : files)
+    {
+        if (job.IsCancelled())
+            break;
 
-        // we upload files in chunks ('blocks')
-        // blocks of up to 100 MB would be possible, but become more and more unreliable
-        // however, for larger files, we mustn't use too many blocks, otherwise the commit fails, so use larger chunks there
+        const QString blobPath = scan->m_destDirectory + scan->m_sourceRootDirectory.relativeFilePath(fileInfo.filePath());
 
-        m_maxBytes = GetMB(2);
+        QByteArray contentMd5;
 
-        if (m_size > GetGB(1))
+        if (scan->m_skipUnchangedFiles && IsUnchangedFile(scan->m_remoteBlobs, blobPath, fileInfo, contentMd5))
         {
-            m_maxBytes = GetMB(4);
+            m_skippedFiles.fetch_add(1);
+            m_skippedBytes.fetch_add(fileInfo.size());
+            continue;
         }
-        
-        if (m_size > GetGB(2))
+
+        uploads.push_back(CreateFileUpload(scan->m_job, fileInfo, scan->m_accountName, scan->m_containerName, blobPath, contentMd5));
+    }
+
+    // the files of this folder start uploading right away, while the sub-folders are still being scanned
+    ScheduleFileUploads(job, uploads);
+
+    // only now that the files are counted, this scan may end
+    job.m_pendingScans.fetch_sub(1);
+    m_pendingScans.fetch_sub(1);
+}
+
+void FileUploader::PauseAllUploads()
+{
+    std::lock_guard<std::mutex> lock(m_jobsMutex);
+
+    for (const auto& job : m_jobs)
+    {
+        job->Pause();
+    }
+}
+
+void FileUploader::ResumeAllUploads()
+{
+    std::lock_guard<std::mutex> lock(m_jobsMutex);
+
+    for (const auto& job : m_jobs)
+    {
+        job->Resume();
+    }
+}
+
+void FileUploader::CancelAllUploads(bool waitForCompletion)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+
+        for (const auto& job : m_jobs)
         {
-            m_maxBytes = GetMB(8);
+            job->Cancel();
         }
-        
-        if (m_size > GetGB(4))
+    }
+
+    if (waitForCompletion)
+    {
+        // cancelled scans stop without queuing anything, after that no more uploads can be added
+        m_scanWorkers->WaitUntilIdle();
+
+        // the cancelled work still runs once to finish its files, but it doesn't send any more data
+        m_workerPool->WaitUntilIdle();
+    }
+}
+
+bool FileUploader::AreUploadsPaused() const
+{
+    std::lock_guard<std::mutex> lock(m_jobsMutex);
+
+    bool anyPaused = false;
+
+    for (const auto& job : m_jobs)
+    {
+        if (job->IsFinished())
+            continue;
+
+        if (!job->IsPaused())
+            return false;
+
+        anyPaused = true;
+    }
+
+    return anyPaused;
+}
+
+void FileUploader::NotifyBytesRead(FileUpload& upload, int64_t bytes)
+{
+    upload.m_uploadedBytes.fetch_add(bytes);
+    m_bytesRead.fetch_add(bytes);
+}
+
+void FileUploader::SampleProgress()
+{
+    FileUploadProgress progress;
+
+    // the scans are read first, a scan only ends after it has added its files, so the uploads can't appear to be done in between
+    progress.m_scanning = m_pendingScans > 0;
+    progress.m_remainingFiles = m_remainingFiles;
+    progress.m_finishedFiles = m_finishedFiles;
+    progress.m_failedFiles = m_failedFiles;
+    progress.m_cancelledFiles = m_cancelledFiles;
+    progress.m_skippedFiles = m_skippedFiles;
+    progress.m_paused = AreUploadsPaused();
+    progress.m_retriedBlocks = m_retriedBlocks;
+    progress.m_waitingRetries = m_waitingRetries;
+    progress.m_uploadedBytes = m_bytesRead;
+    progress.m_totalBytes = m_totalBytesToRead;
+    progress.m_skippedBytes = m_skippedBytes;
+    progress.m_percentage = (progress.m_totalBytes > 0) ? (double)progress.m_uploadedBytes / (double)progress.m_totalBytes : 1.0;
+
+    // progress arrives in whole blocks, so the speed is smoothed over a few seconds
+    const auto now = std::chrono::steady_clock::now();
+    const double elapsedSeconds = std::chrono::duration<double>(now - m_lastSampleTime).count();
+
+    if (elapsedSeconds > 0.0)
+    {
+        const double bytesPerSecond = (progress.m_uploadedBytes - m_lastSampledBytes) / elapsedSeconds;
+        const double weight = std::min(1.0, elapsedSeconds / 3.0);
+
+        m_smoothedBytesPerSecond = (m_smoothedBytesPerSecond > 0.0) ? ((1.0 - weight) * m_smoothedBytesPerSecond + weight * bytesPerSecond) : bytesPerSecond;
+        m_lastSampleTime = now;
+        m_lastSampledBytes = progress.m_uploadedBytes;
+    }
+
+    progress.m_bytesPerSecond = m_smoothedBytesPerSecond;
+
+    // while folders are still scanned, the total isn't known, so neither is the remaining time
+    if (m_smoothedBytesPerSecond > 0.0 && !progress.m_paused && !progress.m_scanning)
+    {
+        progress.m_secondsRemaining = (int)std::ceil((progress.m_totalBytes - progress.m_uploadedBytes) / m_smoothedBytesPerSecond);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_activeUploadsMutex);
+
+        progress.m_activeFiles.reserve(m_activeUploads.size());
+        for (const auto& upload : m_activeUploads)
         {
-            m_maxBytes = GetMB(16);
+            FileUploadState state;
+            state.m_sourceFilePath = upload->m_sourceFilePath;
+            state.m_uploadedBytes = upload->m_uploadedBytes;
+            state.m_totalBytes = upload->m_fileSize;
+            progress.m_activeFiles.push_back(std::move(state));
         }
-        
-        if (m_size > GetGB(8))
+    }
+
+    if (progress.m_remainingFiles == 0 && !progress.m_scanning)
+    {
+        m_progressTimer->stop();
+    }
+
+    m_progressCallback(progress);
+}
+
+/// Reads one block of a file, ie. the byte range [offset; offset + length).
+///
+/// Every block uses its own stream (and file handle), such that multiple blocks of the same file can be staged concurrently.
+class FileStream : public Azure::Core::IO::BodyStream
+{
+public:
+    FileStream(const QString& path, int64_t offset, int64_t length, UploadRateLimiter* rateLimiter)
+        : m_file(path)
+        , m_offset(offset)
+        , m_length(length)
+        , m_rateLimiter(rateLimiter)
+    {
+        if (!m_file.open(QIODevice::OpenModeFlag::ReadOnly) || !m_file.seek(m_offset))
         {
-            m_maxBytes = GetMB(32);
+            throw std::runtime_error("Failed to open file for reading.");
         }
     }
 
     virtual int64_t Length() const override
     {
-        return std::min(m_maxBytes, (m_size - m_offset));
+        return m_length;
     }
 
     virtual void Rewind() override
@@ -153,117 +731,944 @@ public:
         {
             m_read = 0;
             m_file.seek(m_offset);
+            ++m_retries;
         }
     }
 
-    bool FinishBlock()
+    /// Returns how often the Storage SDK had to send the data again.
+    int GetRetries() const
     {
-        // the next block starts at this offset
-        m_offset += m_read;
-        m_read = 0;
-        return m_offset < m_size; // return true, if there is more work left to do
-    }
-
-    int64_t GetBytesRead() const
-    {
-        return m_read;
+        return m_retries;
     }
 
 private:
-    virtual size_t OnRead(uint8_t* buffer, size_t count, Azure::Core::Context const& /*context*/) override
+    virtual size_t OnRead(uint8_t* buffer, size_t count, Azure::Core::Context const& context) override
     {
-        count = std::min<size_t>(m_maxBytes - m_read, count);
+        context.ThrowIfCancelled();
+
+        count = std::min<size_t>(m_length - m_read, count);
 
         if (count == 0)
             return 0;
 
+        // the data is read right before it is sent, so this throttles the upload
+        count = m_rateLimiter->Acquire(count);
+
         const int64_t read = m_file.read((char*)buffer, count);
+
+        if (read < 0)
+        {
+            throw std::runtime_error("Failed to read from file.");
+        }
+
         m_read += read;
         return (size_t)read;
     }
 
     QFile m_file;
-    int64_t m_read = 0;
-    int64_t m_size = 0;
     int64_t m_offset = 0;
-    int64_t m_maxBytes = 0;
+    int64_t m_length = 0;
+    int64_t m_read = 0;
+    int m_retries = 0;
+    UploadRateLimiter* m_rateLimiter = nullptr;
 };
 
-// upload one file to a blob storage directory synchronously. SourceRootDirectory will map to destDirectory
-void FileUploader::UploadFileInternalSync(const QDir& sourceRootDirectory, const QString& sourceFilePath, const QString& containerName, const QString& destDirectory)
+/// Reads one block of a file from memory, either from a BlockBuffer or from a MappedFile.
+///
+/// When the Storage SDK has to send a block again, rewinding the stream is just a pointer reset, the file isn't read again.
+class MemoryBlockStream : public Azure::Core::IO::BodyStream
 {
-    // after it's opened, upload it to the blob path
-    QString blobPath = (destDirectory + sourceRootDirectory.relativeFilePath(sourceFilePath));
-
-    try
+public:
+    MemoryBlockStream(const uint8_t* data, int64_t length, UploadRateLimiter* rateLimiter)
+        : m_data(data)
+        , m_length(length)
+        , m_rateLimiter(rateLimiter)
     {
-        {
-            auto container = m_storageAccount->GetStorageContainerFromName(containerName);
+    }
 
+    virtual int64_t Length() const override
+    {
+        return m_length;
+    }
+
+    virtual void Rewind() override
+    {
+        if (m_read > 0)
+        {
+            m_read = 0;
+            ++m_retries;
+        }
+    }
+
+    /// Returns how often the Storage SDK had to send the data again.
+    int GetRetries() const
+    {
+        return m_retries;
+    }
+
+private:
+    virtual size_t OnRead(uint8_t* buffer, size_t count, Azure::Core::Context const& context) override
+    {
+        context.ThrowIfCancelled();
+
+        count = std::min<size_t>(m_length - m_read, count);
+        count = m_rateLimiter->Acquire(count);
+
+        std::memcpy(buffer, m_data + m_read, count);
+        m_read += count;
+        return count;
+    }
+
+    const uint8_t* m_data = nullptr;
+    int64_t m_length = 0;
+    int64_t m_read = 0;
+    int m_retries = 0;
+    UploadRateLimiter* m_rateLimiter = nullptr;
+};
+
+/// One block and its data, which may be read from the source file ahead of time, while the previous block of the same job is still being sent.
+struct FileUploader::BlockRead
+{
+    UploadBlock m_block;
+    BlockBuffer m_buffer;
+    Crc64Hash m_crc64;        ///< The checksum of the data, computed while it is read.
+    QString m_errorMsg;       ///< Set if the data couldn't be read.
+    int m_failedAttempts = 0; ///< How often staging this block failed already.
+
+    std::shared_ptr<BlockRead> m_readAhead; ///< The next block, which was already being read when this block failed and had to wait for a retry.
+
+    std::promise<void> m_done;
+    std::future<void> m_finished; ///< Only valid, if the data is read on another thread.
+};
+
+// reads the data of a block from the source file and adds it to 'outCrc64', which has to be a new hash, returns an error message if that fails
+static QString ReadBlockData(const QString& path, const UploadBlock& block, uint8_t* data, Crc64Hash& outCrc64)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::OpenModeFlag::ReadOnly) || !file.seek(block.m_offset))
+        return "Failed to open file for reading.";
+
+    int64_t read = 0;
+
+    while (read < block.m_size)
+    {
+        const int64_t res = file.read(reinterpret_cast<char*>(data) + read, block.m_size - read);
+
+        if (res <= 0)
+            return "Failed to read from file.";
+
+        read += res;
+    }
+
+    // the data is still in the cache, so the checksum costs hardly anything here, compared to reading the file again later
+    outCrc64.Append(data, (size_t)block.m_size);
+
+    return {};
+}
+
+// stores the MD5 hash as the Content-MD5 property of the blob
+static void SetContentMd5(Models::BlobHttpHeaders& headers, const QByteArray& md5)
+{
+    if (md5.isEmpty())
+        return;
+
+    headers.ContentHash.Algorithm = HashAlgorithm::Md5;
+    headers.ContentHash.Value.assign(md5.begin(), md5.end());
+}
+
+// stores the CRC64 of the entire file as metadata of the blob, the service only keeps checksums of the individual requests
+static void SetContentCrc64(Azure::Storage::Metadata& metadata, const std::vector<uint8_t>& crc64)
+{
+    if (crc64.empty())
+        return;
+
+    metadata[s_crc64MetadataKey] = QByteArray(reinterpret_cast<const char*>(crc64.data()), (qsizetype)crc64.size()).toHex().toStdString();
+}
+
+// the service compares the data of a request against this checksum and rejects it, if it doesn't match
+// hashes can't be copied and only finalized once, so the checksum is taken from a combination of an empty hash and the given one
+static ContentHash ToTransactionalHash(const Crc64Hash& crc64)
+{
+    Crc64Hash copy;
+    copy.Concatenate(crc64);
+
+    ContentHash hash;
+    hash.Algorithm = HashAlgorithm::Crc64;
+    hash.Value = copy.Final();
+    return hash;
+}
+
+// returns the blocks of a previous, interrupted upload of the same file, which are still staged on the server
+static std::vector<UploadBlock> FindResumableBlocks(BlockBlobClient& blobClient, const QString& journalPath, const UploadJournal::Header& header, const Azure::Core::Context& context)
+{
+    std::vector<UploadBlock> journalBlocks;
+    if (!UploadJournal::Load(journalPath, header, journalBlocks) || journalBlocks.empty())
+        return {};
+
+    // uncommitted blocks are discarded by the service after a week, or when another upload commits the blob
+    // so only trust the journal for those blocks that the server still knows about
+    std::map<std::string, int64_t> stagedOnServer;
+
+    try
+    {
+        GetBlockListOptions opt;
+        opt.ListType = Models::BlockListType::Uncommitted;
+
+        auto res = blobClient.GetBlockList(opt, context);
+        for (const auto& block : res.Value.UncommittedBlocks)
+        {
+            stagedOnServer[block.Name] = block.Size;
+        }
+    }
+    catch (const std::exception&)
+    {
+        // the blob doesn't exist (anymore), nothing to resume
+        return {};
+    }
+
+    std::vector<UploadBlock> resumable;
+    for (const UploadBlock& block : journalBlocks)
+    {
+        auto it = stagedOnServer.find(block.m_id);
+        if (it != stagedOnServer.end() && it->second == block.m_size)
+        {
+            resumable.push_back(block);
+        }
+    }
+
+    return resumable;
+}
+
+// splits a mapped file into content-defined chunks, which are named after their MD5 hash, and computes the CRC64 of every chunk and the MD5 hash of the entire file along the way
+// returns false if the context gets cancelled
+static bool SplitIntoChunks(const MappedFile& file, int64_t fileSize, std::vector<UploadBlock>& outChunks, std::map<int64_t, Crc64Hash>& outChunkCrc64, QByteArray& outFileMd5, const Azure::Core::Context& context)
+{
+    const ContentChunker chunker(fileSize);
+    QCryptographicHash fileHash(QCryptographicHash::Md5);
+
+    int64_t offset = 0;
+
+    while (offset < fileSize)
+    {
+        if (context.IsCancelled())
+            return false;
+
+        UploadBlock chunk;
+        chunk.m_offset = offset;
+        chunk.m_size = chunker.GetChunkLength(file.GetData(offset), fileSize - offset);
+
+        const QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char*>(file.GetData(offset)), (qsizetype)chunk.m_size);
+        fileHash.addData(data);
+        outChunkCrc64[offset].Append(file.GetData(offset), (size_t)chunk.m_size);
+
+        // 32 hex characters, like the block IDs of regular uploads, since all blocks of a blob need IDs of the same length
+        chunk.m_id = QCryptographicHash::hash(data, QCryptographicHash::Md5).toHex().toStdString();
+
+        offset += chunk.m_size;
+        outChunks.push_back(std::move(chunk));
+    }
+
+    outFileMd5 = fileHash.result();
+    return true;
+}
+
+// returns the names and sizes of all blocks of a blob, the committed ones as well as those that an interrupted upload has staged
+static std::map<std::string, int64_t> GetBlocksOnServer(BlockBlobClient& blobClient, const Azure::Core::Context& context)
+{
+    std::map<std::string, int64_t> blocks;
+
+    try
+    {
+        GetBlockListOptions opt;
+        opt.ListType = Models::BlockListType::All;
+
+        auto res = blobClient.GetBlockList(opt, context);
+        for (const auto& block : res.Value.CommittedBlocks)
+        {
+            blocks[block.Name] = block.Size;
+        }
+        for (const auto& block : res.Value.UncommittedBlocks)
+        {
+            blocks[block.Name] = block.Size;
+        }
+    }
+    catch (const std::exception&)
+    {
+        // the blob doesn't exist yet, all chunks have to be uploaded
+    }
+
+    return blocks;
+}
+
+// prepares the upload of one file and queues a job for every block of it
+void FileUploader::StartFileUpload(const std::shared_ptr<FileUpload>& upload)
+{
+    const Azure::Core::Context& context = upload->m_job->GetContext();
+
+    if (upload->m_job->IsCancelled())
+    {
+        FinishFileUpload(upload);
+        return;
+    }
+
+    upload->m_timer.start();
+
+    {
+        std::lock_guard<std::mutex> lock(m_activeUploadsMutex);
+        m_activeUploads.push_back(upload);
+    }
+
+    // we can't upload files larger than 100MB in one operation
+    // for one, this is not even allowed
+    // and two, the larger the block, the more likely it becomes that the upload fails
+    // the actual block sizes are chosen by the BlockSizePolicy while the upload runs, this is only the nominal size for this file
+    upload->m_blockSize = BlockSizePolicy::GetFixedBlockSize(upload->m_fileSize);
+
+    // delta uploads need the chunks of the entire file up front, their checksums and the MD5 hash of the file are computed in the same pass
+    // chunking reads the file from a mapping, without one, the file is uploaded regularly
+    std::vector<UploadBlock> chunks;
+
+    if (m_deltaUploads && upload->m_fileSize > upload->m_blockSize)
+    {
+        upload->m_mappedFile = std::make_unique<MappedFile>(upload->m_sourceFilePath);
+
+        if (!upload->m_mappedFile->IsValid())
+        {
+            upload->m_mappedFile.reset();
+        }
+        else if (!SplitIntoChunks(*upload->m_mappedFile, upload->m_fileSize, chunks, upload->m_blockCrc64, upload->m_contentMd5, context))
+        {
+            chunks.clear();
+        }
+    }
+
+    // the MD5 hash is stored as the Content-MD5 property of the blob, so that later uploads can detect unchanged files
+    // unless the check for unchanged files computed it already, it is computed from the data that is read for sending anyway
+    if (chunks.empty())
+    {
+        upload->m_blockCrc64.clear();
+        upload->m_hashWhileStaging = upload->m_contentMd5.isEmpty();
+    }
+
+    UploadJournal::Header journalHeader;
+    journalHeader.m_sourceFilePath = upload->m_sourceFilePath;
+    journalHeader.m_fileSize = upload->m_fileSize;
+    journalHeader.m_lastModified = upload->m_lastModified;
+    journalHeader.m_blockSize = upload->m_blockSize;
+
+    std::vector<UploadBlock> stagedBlocks;
+    std::map<std::string, int64_t> blocksOnServer;
+
+    try
+    {
+        auto container = m_storageAccount->GetStorageContainerFromName(upload->m_containerName);
+        upload->m_blobClient = container.GetBlockBlobClient(upload->m_blobPath.toStdString());
+
+        if (upload->m_fileSize <= upload->m_blockSize)
+        {
+            // small files are uploaded with a single request, that saves the extra round trip for committing a block list
+            // they are read into memory once, the checksums and the request all use that data
+            UploadBlock wholeFile;
+            wholeFile.m_size = upload->m_fileSize;
+
+            BlockBuffer buffer = m_bufferPool.Acquire(wholeFile.m_size);
+            Crc64Hash crc64;
+            const QString readError = ReadBlockData(upload->m_sourceFilePath, wholeFile, buffer.GetData(), crc64);
+
+            if (!readError.isEmpty())
+            {
+                m_bufferPool.Release(std::move(buffer));
+                throw std::runtime_error(readError.toStdString());
+            }
+
+            if (upload->m_hashWhileStaging)
+            {
+                upload->m_contentMd5 = QCryptographicHash::hash(QByteArray::fromRawData(reinterpret_cast<const char*>(buffer.GetData()), (qsizetype)wholeFile.m_size), QCryptographicHash::Md5);
+            }
+
+            const ContentHash crc64Hash = ToTransactionalHash(crc64);
+
+            UploadBlockBlobOptions opt;
+            SetContentMd5(opt.HttpHeaders, upload->m_contentMd5);
+            SetContentCrc64(opt.Metadata, crc64Hash.Value);
+            opt.TransactionalContentHash = crc64Hash;
+
+            MemoryBlockStream stream(buffer.GetData(), wholeFile.m_size, &m_rateLimiter);
+
+            try
+            {
+                upload->m_blobClient->Upload(stream, opt, context);
+            }
+            catch (...)
+            {
+                m_bufferPool.Release(std::move(buffer));
+                throw;
+            }
+
+            m_bufferPool.Release(std::move(buffer));
+            NotifyBytesRead(*upload, stream.Length());
+            m_retriedBlocks.fetch_add(stream.GetRetries());
+
+            // an upload of the same file that was interrupted earlier is overwritten now
+            if (upload->m_resume)
+            {
+                UploadJournal::Remove(upload->m_journalPath);
+            }
+
+            FinishFileUpload(upload);
+            return;
+        }
+
+        if (!chunks.empty())
+        {
+            blocksOnServer = GetBlocksOnServer(*upload->m_blobClient, context);
+        }
+        else if (upload->m_resume)
+        {
+            stagedBlocks = FindResumableBlocks(*upload->m_blobClient, upload->m_journalPath, journalHeader, context);
+        }
+
+        // there is no need to purge stale uncommitted blocks of earlier uploads before staging new ones
+        // the block IDs of this upload are unique, and committing the block list discards all blocks that are not in it
+    }
+    catch (const std::exception& e)
+    {
+        upload->SetFailed(e.what());
+        FinishFileUpload(upload);
+        return;
+    }
+
+    if (!chunks.empty() && upload->m_resume)
+    {
+        // the chunks on the server take the place of the journal, the journal of an earlier regular upload of this file is of no use anymore
+        UploadJournal::Remove(upload->m_journalPath);
+        upload->m_resume = false;
+    }
+
+    if (upload->m_resume && !upload->m_journal.Start(upload->m_journalPath, journalHeader, stagedBlocks))
+    {
+        qWarning(LoggingCategory::AzureStorage) << "Failed to write upload journal, the upload won't be resumable:" << upload->m_journalPath;
+    }
+
+    upload->m_blockIdNonce = CreateBlockIdNonce();
+
+    int64_t stagedBytes = 0;
+
+    if (!chunks.empty())
+    {
+        // chunks that the server already has, from the previous version of the blob or from an interrupted upload, are only referenced in the block list
+        // identical chunks within the file are only uploaded once as well
+        std::set<std::string> plannedChunks;
+
+        for (const UploadBlock& chunk : chunks)
+        {
+            auto it = blocksOnServer.find(chunk.m_id);
+
+            if ((it != blocksOnServer.end() && it->second == chunk.m_size) || plannedChunks.count(chunk.m_id) != 0)
+            {
+                upload->m_blocks.push_back(chunk);
+                stagedBytes += chunk.m_size;
+            }
+            else
+            {
+                plannedChunks.insert(chunk.m_id);
+                upload->m_plannedBlocks.push_back(chunk);
+            }
+        }
+    }
+    else
+    {
+        // reuse what is already staged, everything in between still needs to be uploaded
+        std::sort(stagedBlocks.begin(), stagedBlocks.end(), [](const UploadBlock& lhs, const UploadBlock& rhs)
+                  { return lhs.m_offset < rhs.m_offset; });
+
+        int64_t offset = 0;
+
+        for (const UploadBlock& staged : stagedBlocks)
+        {
+            // ignore blocks that overlap with previous ones or lie outside the file, they would corrupt the data
+            if (staged.m_offset < offset || staged.m_offset + staged.m_size > upload->m_fileSize)
+                continue;
+
+            if (offset < staged.m_offset)
+            {
+                upload->m_gaps.push_back({offset, staged.m_offset});
+            }
+
+            upload->m_blocks.push_back(staged);
+            offset = staged.m_offset + staged.m_size;
+            stagedBytes += staged.m_size;
+
+            // the data of the blocks that are already staged is only read again, once the hash gets to them
+            if (upload->m_hashWhileStaging)
+            {
+                upload->m_unhashedBlocks.emplace(staged.m_offset, std::make_pair(staged, BlockBuffer()));
+            }
+        }
+
+        if (offset < upload->m_fileSize)
+        {
+            upload->m_gaps.push_back({offset, upload->m_fileSize});
+        }
+    }
+
+    upload->m_unscheduledBytes = upload->m_fileSize - stagedBytes;
+
+    if (stagedBytes > 0)
+    {
+        qInfo(LoggingCategory::AzureStorage)
+            << (chunks.empty() ? "Resuming file upload." : "Uploading the modified chunks of the file.")
+            << "\n  Src: " << upload->m_sourceFilePath
+            << "\n  Dst: " << upload->m_blobPath
+            << "\n  Already uploaded: " << QString("%1 MB").arg(stagedBytes / (1024.0 * 1024.0), 0, 'f', 2);
+
+        NotifyBytesRead(*upload, stagedBytes);
+    }
+
+    if (upload->m_unscheduledBytes == 0)
+    {
+        // everything was staged before, only the commit is missing
+        FinishFileUpload(upload);
+        return;
+    }
+
+    // every block is a separate job, so that idle workers can help with large files
+    // each job queues the next one when it is done, as long as there is data left, so the number of parallel jobs per file stays the same
+    const int64_t estimatedBlocks = chunks.empty() ? (upload->m_unscheduledBytes + upload->m_blockSize - 1) / upload->m_blockSize : (int64_t)upload->m_plannedBlocks.size();
+    const int numJobs = (int)std::clamp<int64_t>(estimatedBlocks, 1, GetMaxParallelUploads());
+
+    upload->m_activeJobs = numJobs;
+
+    for (int i = 1; i < numJobs; ++i)
+    {
+        upload->m_job->Schedule(upload->m_fileSize, [this, upload]()
+                                { StageNextBlock(upload, nullptr); });
+    }
+
+    // this worker does the first block itself
+    StageNextBlock(upload, nullptr);
+}
+
+std::shared_ptr<FileUploader::BlockRead> FileUploader::StartReadAhead(const std::shared_ptr<FileUpload>& upload)
+{
+    // mapped files are read by the page cache, and a job that is about to stop doesn't need another block
+    if (upload->m_mappedFile || upload->m_failed || upload->m_job->IsCancelled())
+        return nullptr;
+
+    auto read = std::make_shared<BlockRead>();
+
+    if (!upload->TakeNextBlock(m_blockSizePolicy, read->m_block))
+        return nullptr;
+
+    // without memory to spare, the block is read once it is staged, as if there was no read-ahead
+    read->m_buffer = m_bufferPool.TryAcquire(read->m_block.m_size);
+
+    if (!read->m_buffer.IsValid())
+        return read;
+
+    read->m_finished = read->m_done.get_future();
+
+    m_readWorkers->AddJob(0, [path = upload->m_sourceFilePath, read]()
+                          {
+                              read->m_errorMsg = ReadBlockData(path, read->m_block, read->m_buffer.GetData(), read->m_crc64);
+                              read->m_done.set_value(); });
+
+    return read;
+}
+
+void FileUploader::StageNextBlock(const std::shared_ptr<FileUpload>& upload, std::shared_ptr<BlockRead> read)
+{
+    // a read that is still running has to be done, before its buffer can be used or returned
+    if (read && read->m_finished.valid())
+    {
+        read->m_finished.wait();
+    }
+
+    if (!read && !upload->m_failed && !upload->m_job->IsCancelled())
+    {
+        read = std::make_shared<BlockRead>();
+
+        if (!upload->TakeNextBlock(m_blockSizePolicy, read->m_block))
+        {
+            read.reset();
+        }
+    }
+
+    if (!read || upload->m_failed || upload->m_job->IsCancelled())
+    {
+        if (read)
+        {
+            // a block that waited for a retry may already have the next one read ahead
+            if (read->m_readAhead)
             {
-                // first upload a dummy file without blob blocks, such that any potentially existing blocks on the server get discarded
-                // see https://gauravmantri.com/2013/05/18/windows-azure-blob-storage-dealing-with-the-specified-blob-or-block-content-is-invalid-error/
+                if (read->m_readAhead->m_finished.valid())
                 {
-                    QByteArray data = QString("dummy").toUtf8();
-                    Azure::Core::IO::MemoryBodyStream dummyStream(reinterpret_cast<const uint8_t*>(data.data()), data.length());
-                    container.UploadBlob(blobPath.toStdString(), dummyStream);
+                    read->m_readAhead->m_finished.wait();
                 }
 
-                // now delete that blob again, to purge everything associated with this blob
-                // after this, we can safely upload the data in multiple blocks
-                container.DeleteBlob(blobPath.toStdString());
+                m_bufferPool.Release(std::move(read->m_readAhead->m_buffer));
+            }
+
+            m_bufferPool.Release(std::move(read->m_buffer));
+        }
+
+        // whoever ends the last job, finishes the file
+        if (upload->m_activeJobs.fetch_sub(1) == 1)
+        {
+            FinishFileUpload(upload);
+        }
+
+        return;
+    }
+
+    const UploadBlock& block = read->m_block;
+
+    // nothing was read ahead for this block, so it is read right here
+    if (!upload->m_mappedFile && !read->m_buffer.IsValid())
+    {
+        read->m_buffer = m_bufferPool.Acquire(block.m_size);
+        read->m_errorMsg = ReadBlockData(upload->m_sourceFilePath, block, read->m_buffer.GetData(), read->m_crc64);
+    }
+
+    std::shared_ptr<BlockRead> nextRead;
+
+    if (!read->m_errorMsg.isEmpty())
+    {
+        upload->SetFailed(read->m_errorMsg);
+    }
+    else
+    {
+        // the next block is read from disk, while this one is on the wire
+        // unless this is a retry, then that happened the first time already
+        nextRead = read->m_readAhead ? std::move(read->m_readAhead) : StartReadAhead(upload);
+
+        try
+        {
+            QElapsedTimer timer;
+            timer.start();
+
+            // the service rejects the block, if the data doesn't match the checksum of what was read from disk
+            // mapped files are only read while they are sent, their checksums were computed when the chunks were found
+            StageBlockOptions opt;
+
+            if (upload->m_mappedFile)
+            {
+                std::lock_guard<std::mutex> lock(upload->m_planMutex);
+                opt.TransactionalContentHash = ToTransactionalHash(upload->m_blockCrc64[block.m_offset]);
+            }
+            else
+            {
+                opt.TransactionalContentHash = ToTransactionalHash(read->m_crc64);
+            }
+
+            MemoryBlockStream stream(upload->m_mappedFile ? upload->m_mappedFile->GetData(block.m_offset) : read->m_buffer.GetData(), block.m_size, &m_rateLimiter);
+            upload->m_blobClient->StageBlock(block.m_id, stream, opt, upload->m_job->GetContext());
+
+            m_blockSizePolicy.ReportBlockStaged(block.m_size, timer.elapsed(), stream.GetRetries());
+            m_retriedBlocks.fetch_add(stream.GetRetries());
+
+            if (upload->m_resume)
+            {
+                upload->m_journal.AddStagedBlock(block);
+            }
+
+            // the checksum of the file is put together from those of its blocks, once all are staged
+            if (!upload->m_mappedFile)
+            {
+                std::lock_guard<std::mutex> lock(upload->m_planMutex);
+                upload->m_blockCrc64[block.m_offset].Concatenate(read->m_crc64);
+            }
+
+            // the data is still in memory, so it is hashed now, or once the blocks before it are
+            if (upload->m_hashWhileStaging)
+            {
+                HashStagedBlock(*upload, block, std::move(read->m_buffer));
+            }
+
+            // update the progress every time a block has finished uploading
+            NotifyBytesRead(*upload, block.m_size);
+        }
+        catch (const std::exception& e)
+        {
+            // an aborted request says nothing about the connection quality
+            if (!upload->m_job->IsCancelled())
+            {
+                m_blockSizePolicy.ReportBlockFailed();
+            }
+
+            // only this block is sent again, the other blocks of the file and everything that was staged so far stay as they are
+            // the data is kept in memory, so it doesn't have to be read again
+            if (!upload->m_job->IsCancelled() && RetryPolicy::IsTransientError(e) && upload->m_blockRetries.fetch_add(1) < s_maxBlockRetriesPerFile)
+            {
+                read->m_failedAttempts++;
+                read->m_readAhead = std::move(nextRead);
+
+                m_retriedBlocks.fetch_add(1);
+                m_waitingRetries.fetch_add(1);
+
+                qWarning(LoggingCategory::AzureStorage)
+                    << "Block upload failed, retrying."
+                    << "\n  Src: " << upload->m_sourceFilePath
+                    << "\n  Offset: " << block.m_offset
+                    << "\n  Attempt: " << read->m_failedAttempts
+                    << "\n  Reason: " << e.what();
+
+                // the block is parked outside of the queue, so it doesn't hold a worker while it waits
+                // once it is due, it is queued like any other block, unless the job is paused by then
+                m_workerPool->AddDelayedJob(RetryPolicy::GetRetryDelay(read->m_failedAttempts), upload->m_fileSize, [this, upload, read]()
+                                            {
+                                                m_waitingRetries.fetch_sub(1);
+                                                upload->m_job->Schedule(upload->m_fileSize, [this, upload, read]()
+                                                                        { StageNextBlock(upload, read); }); });
+
+                // a cancellation that came in between has to find the block in the queue, so that it can finish right away
+                if (upload->m_job->IsCancelled())
+                {
+                    m_workerPool->RunDelayedJobsNow();
+                }
+
+                return;
+            }
+
+            upload->SetFailed(e.what());
+        }
+    }
+
+    m_bufferPool.Release(std::move(read->m_buffer));
+
+    // continue with the next block of this file, the job goes to the back of the queue, so that other files with the same priority get their turn
+    // while the job is paused, this is held back, the block that just finished is already recorded in the journal
+    upload->m_job->Schedule(upload->m_fileSize, [this, upload, nextRead]()
+                            { StageNextBlock(upload, nextRead); });
+}
+
+void FileUploader::HashStagedBlock(FileUpload& upload, const UploadBlock& block, BlockBuffer&& buffer)
+{
+    {
+        std::lock_guard<std::mutex> lock(upload.m_hashMutex);
+
+        // while one block is retried, all following blocks would pile up in memory
+        // they are kept out of the memory budget of all uploads, once that is used up, they are read again when the hash gets to them
+        if (m_bufferPool.IsOverBudget())
+        {
+            m_bufferPool.Release(std::move(buffer));
+        }
+
+        upload.m_unhashedBlocks.emplace(block.m_offset, std::make_pair(block, std::move(buffer)));
+    }
+
+    HashBlocksInOrder(upload);
+}
+
+void FileUploader::HashBlocksInOrder(FileUpload& upload)
+{
+    std::unique_lock<std::mutex> lock(upload.m_hashMutex);
+
+    // only one job hashes at a time, it also takes care of the blocks that other jobs add in the meantime
+    if (upload.m_hashing)
+        return;
+
+    upload.m_hashing = true;
+
+    while (!upload.m_hashFailed && !upload.m_job->IsCancelled())
+    {
+        auto it = upload.m_unhashedBlocks.find(upload.m_hashedBytes);
+        if (it == upload.m_unhashedBlocks.end())
+            break;
+
+        const UploadBlock block = it->second.first;
+        BlockBuffer buffer = std::move(it->second.second);
+        upload.m_unhashedBlocks.erase(it);
+
+        lock.unlock();
+
+        QString errorMsg;
+
+        if (!buffer.IsValid())
+        {
+            // the checksum of a block that was staged by an earlier upload is needed for the commit as well
+            buffer = m_bufferPool.Acquire(block.m_size);
+            Crc64Hash crc64;
+            errorMsg = ReadBlockData(upload.m_sourceFilePath, block, buffer.GetData(), crc64);
+
+            if (errorMsg.isEmpty())
+            {
+                std::lock_guard<std::mutex> planLock(upload.m_planMutex);
+
+                if (upload.m_blockCrc64.count(block.m_offset) == 0)
+                {
+                    upload.m_blockCrc64[block.m_offset].Concatenate(crc64);
+                }
             }
+        }
+
+        if (errorMsg.isEmpty())
+        {
+            upload.m_md5.addData(QByteArray::fromRawData(reinterpret_cast<const char*>(buffer.GetData()), (qsizetype)block.m_size));
+        }
+
+        m_bufferPool.Release(std::move(buffer));
 
-            auto blobClient = container.GetBlockBlobClient(blobPath.toStdString());
-            blobClient.DeleteIfExists();
+        lock.lock();
 
-            FileStream stream(sourceFilePath.toStdString());
+        upload.m_hashedBytes += block.m_size;
+        upload.m_hashFailed = !errorMsg.isEmpty();
+    }
+
+    upload.m_hashing = false;
+}
+
+std::vector<uint8_t> FileUploader::CombineBlockCrc64(FileUpload& upload)
+{
+    // the blocks have to be sorted by offset, which they are, once all of them are staged
+    Crc64Hash fileCrc64;
+
+    for (const UploadBlock& block : upload.m_blocks)
+    {
+        auto it = upload.m_blockCrc64.find(block.m_offset);
+
+        if (it == upload.m_blockCrc64.end())
+        {
+            // blocks that an interrupted upload staged, weren't read this time, so only those are read again
+            Crc64Hash& blockCrc64 = upload.m_blockCrc64[block.m_offset];
 
-            std::vector<std::string> blocks;
-            blocks.reserve(1000);
+            BlockBuffer buffer = m_bufferPool.Acquire(block.m_size);
+            const QString errorMsg = ReadBlockData(upload.m_sourceFilePath, block, buffer.GetData(), blockCrc64);
+            m_bufferPool.Release(std::move(buffer));
 
-            // we can't upload files larger than 100MB in one operation
-            // for one, this is not even allowed
-            // and two, the larger the block, the more likely it becomes that the upload fails
-            do
+            // without the checksum, the blob is still fine, it just can't be verified later
+            if (!errorMsg.isEmpty() || upload.m_job->IsCancelled())
             {
-                // we need a unique name for each staged block, so we generate a GUID
-                QUuid guid = QUuid::createUuid();
-                // have to remove the dashes to make the block identifier valid
-                std::string guidString = guid.toString(QUuid::WithoutBraces).replace("-", "").toStdString();
+                upload.m_blockCrc64.erase(block.m_offset);
+                return {};
+            }
 
-                blocks.push_back(guidString);
-                blobClient.StageBlock(guidString, stream);
+            it = upload.m_blockCrc64.find(block.m_offset);
+        }
 
-                // update the progress every time a block has finished uploading
-                NotifyBytesRead(stream.GetBytesRead());
+        fileCrc64.Concatenate(it->second);
+    }
 
-            } while (stream.FinishBlock());
+    return fileCrc64.Final();
+}
+
+void FileUploader::FinishFileUpload(const std::shared_ptr<FileUpload>& upload)
+{
+    // all blocks are done, release the file mapping
+    upload->m_mappedFile.reset();
+
+    // the staged blocks of a cancelled upload are kept, and so is the journal, so that uploading the file again can resume
+    const bool cancelled = upload->m_job->IsCancelled();
+
+    if (upload->m_hashWhileStaging && !upload->m_blocks.empty())
+    {
+        // blocks that were all staged by an earlier upload, haven't been hashed at all yet
+        if (!cancelled && !upload->m_failed)
+        {
+            HashBlocksInOrder(*upload);
+        }
+
+        std::lock_guard<std::mutex> lock(upload->m_hashMutex);
+
+        if (upload->m_hashedBytes == upload->m_fileSize && !upload->m_hashFailed)
+        {
+            upload->m_contentMd5 = upload->m_md5.result();
+        }
+        else if (!cancelled && !upload->m_failed)
+        {
+            qWarning(LoggingCategory::AzureStorage) << "Failed to hash the file, the blob won't have a Content-MD5:" << upload->m_sourceFilePath;
+        }
+
+        // after a failure, blocks may still wait for the data before them
+        for (auto& unhashed : upload->m_unhashedBlocks)
+        {
+            m_bufferPool.Release(std::move(unhashed.second.second));
+        }
+
+        upload->m_unhashedBlocks.clear();
+    }
+
+    // files that were uploaded in a single request have no blocks to commit
+    if (!cancelled && !upload->m_failed && !upload->m_blocks.empty())
+    {
+        try
+        {
+            // the blocks were scheduled in file order, but resumed blocks were put in front of all new ones
+            std::sort(upload->m_blocks.begin(), upload->m_blocks.end(), [](const UploadBlock& lhs, const UploadBlock& rhs)
+                      { return lhs.m_offset < rhs.m_offset; });
+
+            std::vector<std::string> blockIds;
+            blockIds.reserve(upload->m_blocks.size());
+
+            for (const UploadBlock& block : upload->m_blocks)
+            {
+                blockIds.push_back(block.m_id);
+            }
 
             // tell Azure Storage that the file is finished and from which blocks it is made up
-            blobClient.CommitBlockList(blocks);
+            // the blocks may have finished in any order, but the block list defines the order of the data
+            CommitBlockListOptions opt;
+            SetContentMd5(opt.HttpHeaders, upload->m_contentMd5);
+            SetContentCrc64(opt.Metadata, CombineBlockCrc64(*upload));
+
+            upload->m_blobClient->CommitBlockList(blockIds, opt, upload->m_job->GetContext());
+
+            // the staged blocks are now part of the blob, there is nothing left to resume
+            upload->m_journal.Finish();
+        }
+        catch (const std::exception& e)
+        {
+            upload->SetFailed(e.what());
         }
+    }
+
+    if (cancelled)
+    {
+        qInfo(LoggingCategory::AzureStorage)
+            << "File upload cancelled."
+            << "\n  Src: " << upload->m_sourceFilePath
+            << "\n  Dst: " << upload->m_blobPath;
+    }
+    else if (!upload->m_failed)
+    {
+        // the new file has to show up in the listings of its folder
+        m_storageAccount->InvalidateCache(upload->m_containerName, upload->m_blobPath);
+
+        const double seconds = std::max<qint64>(1, upload->m_timer.elapsed()) / 1000.0;
 
         qInfo(LoggingCategory::AzureStorage)
             << "File upload finished."
-            << "\n  Src: " << sourceFilePath
-            << "\n  Dst: " << blobPath;
+            << "\n  Src: " << upload->m_sourceFilePath
+            << "\n  Dst: " << upload->m_blobPath
+            << "\n  Speed: " << QString("%1 MB/s").arg((upload->m_fileSize / (1024.0 * 1024.0)) / seconds, 0, 'f', 2);
     }
-    catch (const std::exception& e)
+    else
     {
         qCritical(LoggingCategory::AzureStorage)
             << "File upload failed."
-            << "\n  Src: " << sourceFilePath
-            << "\n  Dst: " << blobPath
-            << "\n  Msg: " << e.what();
+            << "\n  Src: " << upload->m_sourceFilePath
+            << "\n  Dst: " << upload->m_blobPath
+            << "\n  Msg: " << upload->m_errorMsg;
     }
 
-    const int remainingFiles = m_remainingFiles.fetch_sub(1) - 1;
+    {
+        std::lock_guard<std::mutex> lock(m_activeUploadsMutex);
+        m_activeUploads.erase(std::remove(m_activeUploads.begin(), m_activeUploads.end(), upload), m_activeUploads.end());
+    }
 
-    const int64_t read = m_bytesRead;
-    const int64_t total = m_totalBytesToRead;
-    const float percentage = (total > 0) ? (double)read / (double)total : 1.0;
+    if (cancelled)
+    {
+        m_cancelledFiles.fetch_add(1);
+    }
+    else if (upload->m_failed)
+    {
+        m_failedFiles.fetch_add(1);
+    }
+    else
+    {
+        m_finishedFiles.fetch_add(1);
+    }
 
-    QMetaObject::invokeMethod(QApplication::instance(), [this, remainingFiles, percentage]()
-                              { m_remainingFilesCallback(remainingFiles, percentage); });
+    upload->m_job->m_remainingFiles.fetch_sub(1);
+    m_remainingFiles.fetch_sub(1);
 }
@@ -1,35 +1,225 @@
 #pragma once
 
+#include <QString>
+#include <Storage/BlockBufferPool.h>
+#include <Storage/BlockSizePolicy.h>
+#include <Storage/UploadJob.h>
+#include <Storage/UploadRateLimiter.h>
 #include <atomic>
+#include <chrono>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <qcontainerfwd.h>
+#include <vector>
 
 class QDir;
-class QString;
+class QFileInfo;
+class QTimer;
 class StorageAccount;
+class WorkerPool;
+struct UploadBlock;
+
+/// The state of a file that is currently being uploaded.
+struct FileUploadState
+{
+    QString m_sourceFilePath;
+    int64_t m_uploadedBytes = 0;
+    int64_t m_totalBytes = 0;
+};
+
+/// A snapshot of the progress of all running file uploads.
+struct FileUploadProgress
+{
+    int m_remainingFiles = 0; ///< Files that are queued or currently uploading.
+    int m_finishedFiles = 0;  ///< Files that were uploaded successfully.
+    int m_failedFiles = 0;    ///< Files whose upload failed.
+    int m_cancelledFiles = 0; ///< Files whose upload was cancelled.
+    int m_skippedFiles = 0;   ///< Files that were not uploaded, because they are unchanged at the destination.
+    int m_retriedBlocks = 0;  ///< How often blocks had to be sent again.
+    int m_waitingRetries = 0; ///< Blocks that failed and are parked until they are sent again.
+
+    int64_t m_uploadedBytes = 0;
+    int64_t m_totalBytes = 0;
+    int64_t m_skippedBytes = 0; ///< The size of the skipped files, they don't count towards the total.
+    float m_percentage = 1.0f;
+
+    double m_bytesPerSecond = 0.0; ///< The smoothed upload speed.
+    int m_secondsRemaining = -1;   ///< The estimated time until all uploads are done, -1 if unknown.
+    bool m_paused = false;         ///< Whether all running uploads are paused.
+    bool m_scanning = false;       ///< Whether folders are still being scanned, so that more files may be added and the total still grows.
+
+    std::vector<FileUploadState> m_activeFiles; ///< The files that are currently being uploaded.
+};
 
 /// Used to upload files to Azure Storage asynchronously.
+///
+/// All uploads share one pool of worker threads. Large files are split into blocks, which are uploaded as separate jobs,
+/// so that a single huge file and many small ones both keep all connections busy.
+/// While a block is sent, the next block of the same job is already read from disk on a separate thread, so that the disk and the network are busy at the same time.
+/// Every block is sent with the CRC64 of the data that was read, so the service rejects blocks that got corrupted on the way.
+/// The CRC64 of the entire file is stored in the "crc64" metadata of the blob.
 class FileUploader
 {
 public:
-    using UpdateCallback = std::function<void(int remainingFiles, float percentage)>;
+    /// Called on the main thread, regularly while uploads are running, and once more after all uploads are done.
+    using UpdateCallback = std::function<void(const FileUploadProgress& progress)>;
 
     FileUploader(UpdateCallback callback, StorageAccount* storageAccount);
 
+    /// Cancels all uploads and waits until the worker threads have stopped.
+    ~FileUploader();
+
+    /// Retrieves the last used upload settings.
+    void LoadSettings();
+
+    /// Stores the current upload settings.
+    void SaveSettings() const;
+
+    /// Sets how many files and blocks are uploaded in parallel.
+    void SetMaxParallelUploads(int maxUploads);
+
+    /// Returns how many files and blocks are uploaded in parallel.
+    int GetMaxParallelUploads() const;
+
+    /// Enables or disables resumable uploads.
+    ///
+    /// When enabled, a local journal is kept of which blocks of a file have been uploaded already.
+    /// If the same file is uploaded to the same location again, after a previous upload was interrupted,
+    /// only the blocks that are still missing on the server are uploaded.
+    void SetResumeUploads(bool enable) { m_resumeUploads = enable; }
+
+    /// Returns whether interrupted uploads are resumed.
+    bool GetResumeUploads() const { return m_resumeUploads; }
+
+    /// Enables or disables adaptive block sizes.
+    ///
+    /// When enabled, the block size follows the measured upload speed, otherwise it only depends on the file size.
+    void SetAdaptiveBlockSize(bool enable) { m_blockSizePolicy.SetAdaptive(enable); }
+
+    /// Returns whether the block size adapts to the upload speed.
+    bool GetAdaptiveBlockSize() const { return m_blockSizePolicy.IsAdaptive(); }
+
+    /// Limits the upload bandwidth of all uploads together. Zero means unlimited.
+    ///
+    /// Takes effect immediately, also for uploads that are already running.
+    void SetMaxBytesPerSecond(int64_t bytesPerSecond) { m_rateLimiter.SetLimit(bytesPerSecond); }
+
+    /// Returns the upload bandwidth limit. Zero means unlimited.
+    int64_t GetMaxBytesPerSecond() const { return m_rateLimiter.GetLimit(); }
+
+    /// Enables or disables delta uploads of large files.
+    ///
+    /// When enabled, large files are split into content-defined chunks (see ContentChunker), which are named after their hash.
+    /// Chunks that the blob at the destination already consists of, are referenced in the new block list instead of being uploaded again,
+    /// so uploading a file that was only modified in a few places, only sends the chunks around the modifications.
+    /// Interrupted delta uploads are resumed the same way, so they don't use the upload journal.
+    void SetDeltaUploads(bool enable) { m_deltaUploads = enable; }
+
+    /// Returns whether large files are uploaded as deltas.
+    bool GetDeltaUploads() const { return m_deltaUploads; }
+
+    /// Enables or disables skipping of unchanged files.
+    ///
+    /// Files that already exist with identical content at the destination, are not uploaded again.
+    /// They are compared by size first, and only if the size matches, by their MD5 hash (the Content-MD5 property of the blob).
+    /// This is only applied by UploadPathsAsync(), UploadFilesAsync() uploads all files it is given.
+    void SetSkipUnchangedFiles(bool enable) { m_skipUnchangedFiles = enable; }
+
+    /// Returns whether unchanged files should be skipped when uploading.
+    bool GetSkipUnchangedFiles() const { return m_skipUnchangedFiles; }
+
     /// Uploads multiple files to a blob storage directory.
     ///
     /// The relative path from sourceRootDirectory to sourceFilePaths is used to determine the relative sub-path in destDirectory.
-    void UploadFilesAsync(const QDir& sourceRootDirectory, const QStringList& sourceFilePaths, const QString& containerName, const QString& destDirectory);
+    /// Larger files are scheduled first, to prevent a single large file from being the only upload left at the end.
+    /// The returned job can be used to pause, resume or cancel the upload of these files. Returns nullptr, if there is nothing to upload.
+    std::shared_ptr<UploadJob> UploadFilesAsync(const QDir& sourceRootDirectory, const QStringList& sourceFilePaths, const QString& containerName, const QString& destDirectory);
+
+    /// Uploads files and entire folders to a blob storage directory, while the folders are still being scanned.
+    ///
+    /// 'sourcePaths' may contain files and folders, folders are uploaded with all files inside them, with the same relative paths as in UploadFilesAsync().
+    /// The folders are scanned on background threads, and the files of every folder are queued for upload as soon as the folder has been read,
+    /// so the first files are uploading long before the scan is done. Until then, the total in the progress keeps growing.
+    /// If unchanged files are skipped, the destination is listed first, and every file is checked when it is found.
+    /// Returns nullptr, if there is nothing to upload.
+    std::shared_ptr<UploadJob> UploadPathsAsync(const QDir& sourceRootDirectory, const QStringList& sourcePaths, const QString& containerName, const QString& destDirectory);
 
-    void NotifyBytesRead(int64_t bytes);
+    /// Pauses all upload jobs that are currently running.
+    void PauseAllUploads();
+
+    /// Resumes all paused upload jobs.
+    void ResumeAllUploads();
+
+    /// Cancels all upload jobs.
+    ///
+    /// If waitForCompletion is true, this blocks until all workers have stopped working on the cancelled jobs.
+    /// That is necessary before the storage account connection is changed, since the workers access it.
+    void CancelAllUploads(bool waitForCompletion);
+
+    /// Whether there are unfinished upload jobs and all of them are paused.
+    bool AreUploadsPaused() const;
 
 private:
-    UpdateCallback m_remainingFilesCallback;
+    struct FileUpload;
+    struct FolderScan;
+    struct BlockRead;
+
+    std::shared_ptr<UploadJob> CreateUploadJob();
+    std::shared_ptr<FileUpload> CreateFileUpload(const std::shared_ptr<UploadJob>& job, const QFileInfo& fileInfo, const QString& accountName, const QString& containerName, const QString& blobPath, const QByteArray& contentMd5 = QByteArray()) const;
+    void ScheduleFileUploads(UploadJob& job, const std::vector<std::shared_ptr<FileUpload>>& uploads);
+
+    void StartFolderScan(const std::shared_ptr<FolderScan>& scan, const QStringList& sourcePaths);
+    void ScanFolder(const std::shared_ptr<FolderScan>& scan, const QString& folderPath);
+    void ScanFolderEntries(const std::shared_ptr<FolderScan>& scan, const QList<QFileInfo>& files, const QStringList& folders);
+
+    void StartFileUpload(const std::shared_ptr<FileUpload>& upload);
+    std::shared_ptr<BlockRead> StartReadAhead(const std::shared_ptr<FileUpload>& upload);
+    void StageNextBlock(const std::shared_ptr<FileUpload>& upload, std::shared_ptr<BlockRead> read);
+    void HashStagedBlock(FileUpload& upload, const UploadBlock& block, BlockBuffer&& buffer);
+    void HashBlocksInOrder(FileUpload& upload);
+    std::vector<uint8_t> CombineBlockCrc64(FileUpload& upload);
+    void FinishFileUpload(const std::shared_ptr<FileUpload>& upload);
+    void NotifyBytesRead(FileUpload& upload, int64_t bytes);
+    void SampleProgress();
+
+    // the workers only update these counters, the main thread samples them at a fixed rate and reports the progress
+    UpdateCallback m_progressCallback;
     std::atomic<int64_t> m_totalBytesToRead = 0;
     std::atomic<int64_t> m_bytesRead = 0;
     std::atomic<int> m_remainingFiles = 0;
+    std::atomic<int> m_finishedFiles = 0;
+    std::atomic<int> m_failedFiles = 0;
+    std::atomic<int> m_cancelledFiles = 0;
+    std::atomic<int> m_skippedFiles = 0;
+    std::atomic<int64_t> m_skippedBytes = 0;
+    std::atomic<int> m_pendingScans = 0;
+    std::atomic<int> m_retriedBlocks = 0;
+    std::atomic<int> m_waitingRetries = 0;
+
+    mutable std::mutex m_jobsMutex;
+    std::vector<std::shared_ptr<UploadJob>> m_jobs;
+
+    std::mutex m_activeUploadsMutex;
+    std::vector<std::shared_ptr<FileUpload>> m_activeUploads;
 
-    void UploadFileInternalSync(const QDir& sourceRootDirectory, const QString& sourceFile, const QString& containerName, const QString& destDirectory);
+    std::unique_ptr<QTimer> m_progressTimer;
+    std::chrono::steady_clock::time_point m_lastSampleTime;
+    int64_t m_lastSampledBytes = 0;
+    double m_smoothedBytesPerSecond = 0.0;
+
+    bool m_resumeUploads = true;
+    bool m_deltaUploads = false;
+    bool m_skipUnchangedFiles = false;
+    BlockSizePolicy m_blockSizePolicy;
+    UploadRateLimiter m_rateLimiter;
+    BlockBufferPool m_bufferPool;
 
     StorageAccount* m_storageAccount = nullptr;
+
+    // the workers are declared last, so that they are stopped before anything they use gets destroyed
+    // the upload workers wait for reads, and the folder scans queue uploads, so each pool is stopped before the one above it
+    std::unique_ptr<WorkerPool> m_readWorkers;
+    std::unique_ptr<WorkerPool> m_workerPool;
+    std::unique_ptr<WorkerPool> m_scanWorkers;
 };
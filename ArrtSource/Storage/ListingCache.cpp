@@ -0,0 +1,181 @@
+#include <Storage/ListingCache.h>
+#include <Storage/StorageAccount.h>
+
+static constexpr int64_t s_defaultMemoryBudget = 64 * 1024 * 1024;
+static constexpr std::chrono::seconds s_defaultTimeToLive(5 * 60);
+
+// a rough estimate of how much memory a listing uses, the exact number doesn't matter for the eviction
+static int64_t EstimateSize(const std::vector<StorageBlobInfo>& infos)
+{
+    int64_t size = 0;
+
+    for (const StorageBlobInfo& info : infos)
+    {
+        size += sizeof(StorageBlobInfo) + (info.m_path.size() + info.m_etag.size()) * sizeof(QChar) + info.m_contentHash.size();
+    }
+
+    return size;
+}
+
+ListingCache::ListingCache()
+    : m_memoryBudget(s_defaultMemoryBudget)
+    , m_timeToLive(s_defaultTimeToLive.count())
+{
+}
+
+void ListingCache::SetMemoryBudget(int64_t bytes)
+{
+    m_memoryBudget = std::max<int64_t>(0, bytes);
+
+    for (Shard& shard : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.m_mutex);
+        EvictEntries(shard);
+    }
+}
+
+void ListingCache::SetTimeToLive(std::chrono::seconds ttl)
+{
+    // only affects listings that are stored from now on
+    m_timeToLive = std::max<int64_t>(0, ttl.count());
+}
+
+bool ListingCache::Get(const QString& containerName, const QString& prefixPath, std::vector<StorageBlobInfo>& directories, std::vector<StorageBlobInfo>& files)
+{
+    const QString key = MakeKey(containerName, prefixPath);
+    Shard& shard = GetShard(key);
+
+    std::lock_guard<std::mutex> lock(shard.m_mutex);
+
+    auto lookupIt = shard.m_lookup.find(key);
+    if (lookupIt == shard.m_lookup.end())
+        return false;
+
+    auto it = lookupIt->second;
+
+    if (it->m_expiration <= std::chrono::steady_clock::now())
+    {
+        EraseEntry(shard, it);
+        return false;
+    }
+
+    // mark as most recently used
+    shard.m_entries.splice(shard.m_entries.begin(), shard.m_entries, it);
+
+    directories = it->m_directories;
+    files = it->m_files;
+    return true;
+}
+
+void ListingCache::Put(const QString& containerName, const QString& prefixPath, const std::vector<StorageBlobInfo>& directories, const std::vector<StorageBlobInfo>& files)
+{
+    Entry entry;
+    entry.m_key = MakeKey(containerName, prefixPath);
+    entry.m_directories = directories;
+    entry.m_files = files;
+    entry.m_expiration = std::chrono::steady_clock::now() + std::chrono::seconds(m_timeToLive.load());
+    entry.m_size = sizeof(Entry) + entry.m_key.size() * sizeof(QChar) + EstimateSize(directories) + EstimateSize(files);
+
+    Shard& shard = GetShard(entry.m_key);
+
+    std::lock_guard<std::mutex> lock(shard.m_mutex);
+
+    auto lookupIt = shard.m_lookup.find(entry.m_key);
+    if (lookupIt != shard.m_lookup.end())
+    {
+        EraseEntry(shard, lookupIt->second);
+    }
+
+    shard.m_size += entry.m_size;
+    shard.m_entries.push_front(std::move(entry));
+    shard.m_lookup[shard.m_entries.front().m_key] = shard.m_entries.begin();
+
+    EvictEntries(shard);
+}
+
+void ListingCache::Invalidate(const QString& containerName, const QString& path)
+{
+    std::vector<QString> parentKeys;
+
+    // the listing of every parent folder may contain the item or one of its parent folders
+    for (qsizetype slash = path.lastIndexOf('/', path.endsWith('/') ? -2 : -1); slash >= 0; slash = (slash > 0) ? path.lastIndexOf('/', slash - 1) : -1)
+    {
+        parentKeys.push_back(MakeKey(containerName, path.left(slash + 1)));
+    }
+
+    parentKeys.push_back(MakeKey(containerName, QString()));
+
+    for (const QString& key : parentKeys)
+    {
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.m_mutex);
+
+        auto lookupIt = shard.m_lookup.find(key);
+        if (lookupIt != shard.m_lookup.end())
+        {
+            EraseEntry(shard, lookupIt->second);
+        }
+    }
+
+    if (!path.endsWith('/'))
+        return;
+
+    // everything inside a deleted folder is gone as well, these listings can be in any shard
+    const QString folderKey = MakeKey(containerName, path);
+
+    for (Shard& shard : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.m_mutex);
+
+        for (auto it = shard.m_entries.begin(); it != shard.m_entries.end();)
+        {
+            auto next = std::next(it);
+
+            if (it->m_key.startsWith(folderKey))
+            {
+                EraseEntry(shard, it);
+            }
+
+            it = next;
+        }
+    }
+}
+
+void ListingCache::Clear()
+{
+    for (Shard& shard : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.m_mutex);
+
+        shard.m_entries.clear();
+        shard.m_lookup.clear();
+        shard.m_size = 0;
+    }
+}
+
+QString ListingCache::MakeKey(const QString& containerName, const QString& prefixPath)
+{
+    return containerName + "##" + prefixPath;
+}
+
+ListingCache::Shard& ListingCache::GetShard(const QString& key)
+{
+    return m_shards[qHash(key) % s_numShards];
+}
+
+void ListingCache::EraseEntry(Shard& shard, std::list<Entry>::iterator it)
+{
+    shard.m_size -= it->m_size;
+    shard.m_lookup.erase(it->m_key);
+    shard.m_entries.erase(it);
+}
+
+void ListingCache::EvictEntries(Shard& shard)
+{
+    const int64_t shardBudget = m_memoryBudget / s_numShards;
+
+    while (shard.m_size > shardBudget && !shard.m_entries.empty())
+    {
+        EraseEntry(shard, std::prev(shard.m_entries.end()));
+    }
+}
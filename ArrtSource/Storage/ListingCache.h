@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QString>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct StorageBlobInfo;
+
+/// A thread-safe cache for storage folder listings.
+///
+/// The cache is split into shards with their own lock, so that listings on multiple threads rarely wait for each other.
+/// Each shard evicts its least recently used entries, once it exceeds its share of the memory budget.
+/// Entries expire after a fixed time, so that changes made by other tools eventually show up.
+class ListingCache
+{
+public:
+    ListingCache();
+
+    /// Sets the approximate amount of memory that all cached listings together may use.
+    void SetMemoryBudget(int64_t bytes);
+
+    /// Returns the memory budget in bytes.
+    int64_t GetMemoryBudget() const { return m_memoryBudget; }
+
+    /// Sets after how long a cached listing is discarded.
+    void SetTimeToLive(std::chrono::seconds ttl);
+
+    /// Returns after how long a cached listing is discarded.
+    std::chrono::seconds GetTimeToLive() const { return std::chrono::seconds(m_timeToLive.load()); }
+
+    /// Returns the cached listing of the given folder, if available.
+    bool Get(const QString& containerName, const QString& prefixPath, std::vector<StorageBlobInfo>& directories, std::vector<StorageBlobInfo>& files);
+
+    /// Stores the complete listing of the given folder.
+    void Put(const QString& containerName, const QString& prefixPath, const std::vector<StorageBlobInfo>& directories, const std::vector<StorageBlobInfo>& files);
+
+    /// Discards all listings that may have changed, when the item at 'path' was created or deleted.
+    ///
+    /// These are the listings of all parent folders of the item, and if the item is a folder (ends with a slash), all listings inside it.
+    void Invalidate(const QString& containerName, const QString& path);
+
+    /// Discards everything.
+    void Clear();
+
+private:
+    struct Entry
+    {
+        QString m_key;
+        std::vector<StorageBlobInfo> m_directories;
+        std::vector<StorageBlobInfo> m_files;
+        std::chrono::steady_clock::time_point m_expiration;
+        int64_t m_size = 0;
+    };
+
+    struct Shard
+    {
+        std::mutex m_mutex;
+        std::list<Entry> m_entries; ///< Most recently used first.
+        std::unordered_map<QString, std::list<Entry>::iterator> m_lookup;
+        int64_t m_size = 0;
+    };
+
+    static constexpr int s_numShards = 16;
+
+    static QString MakeKey(const QString& containerName, const QString& prefixPath);
+    Shard& GetShard(const QString& key);
+    void EraseEntry(Shard& shard, std::list<Entry>::iterator it);
+    void EvictEntries(Shard& shard);
+
+    std::atomic<int64_t> m_memoryBudget = 0;
+    std::atomic<int64_t> m_timeToLive = 0; ///< In seconds.
+    Shard m_shards[s_numShards];
+};
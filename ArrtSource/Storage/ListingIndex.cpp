@@ -0,0 +1,344 @@
+#include <QCryptographicHash>
+#include <QDir>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <Storage/ListingIndex.h>
+#include <Storage/StorageAccount.h>
+#include <cstring>
+#include <limits>
+
+// the file starts with this tag and the number of folders
+// every folder is stored as: prefix, number of items, size of the items in bytes, items
+// every item is stored as: is-directory flag, size, last modification time, name relative to the prefix, ETag, content hash
+static const char s_indexTag[8] = {'A', 'R', 'R', 'T', 'I', 'D', 'X', '2'};
+
+// reads values from the mapped file, every read checks that it doesn't go past the end
+class IndexReader
+{
+public:
+    IndexReader(const uchar* data, qint64 size)
+        : m_data(data)
+        , m_size(size)
+    {
+    }
+
+    template <typename T>
+    bool Read(T& value)
+    {
+        if (m_pos + (qint64)sizeof(T) > m_size)
+            return false;
+
+        std::memcpy(&value, m_data + m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return true;
+    }
+
+    template <typename LENGTH>
+    bool ReadString(QString& value)
+    {
+        LENGTH length = 0;
+        if (!Read(length) || m_pos + (qint64)length > m_size)
+            return false;
+
+        value = QString::fromUtf8(reinterpret_cast<const char*>(m_data + m_pos), length);
+        m_pos += length;
+        return true;
+    }
+
+    template <typename LENGTH>
+    bool ReadBytes(QByteArray& value)
+    {
+        LENGTH length = 0;
+        if (!Read(length) || m_pos + (qint64)length > m_size)
+            return false;
+
+        value = QByteArray(reinterpret_cast<const char*>(m_data + m_pos), length);
+        m_pos += length;
+        return true;
+    }
+
+    bool Skip(qint64 bytes)
+    {
+        if (m_pos + bytes > m_size)
+            return false;
+
+        m_pos += bytes;
+        return true;
+    }
+
+    qint64 GetPosition() const { return m_pos; }
+
+private:
+    const uchar* m_data = nullptr;
+    qint64 m_size = 0;
+    qint64 m_pos = 0;
+};
+
+template <typename T>
+static void Append(QByteArray& out, T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename LENGTH>
+static void AppendBytes(QByteArray& out, const QByteArray& value)
+{
+    const QByteArray bytes = value.left(std::numeric_limits<LENGTH>::max());
+    Append<LENGTH>(out, (LENGTH)bytes.size());
+    out.append(bytes);
+}
+
+template <typename LENGTH>
+static void AppendString(QByteArray& out, const QString& value)
+{
+    AppendBytes<LENGTH>(out, value.toUtf8());
+}
+
+static void AppendItems(QByteArray& out, const QString& prefixPath, const std::vector<StorageBlobInfo>& infos, bool directories)
+{
+    for (const StorageBlobInfo& info : infos)
+    {
+        Append<quint8>(out, directories ? 1 : 0);
+        Append<qint64>(out, info.m_size);
+        Append<qint64>(out, info.m_lastModified);
+        AppendString<quint16>(out, info.m_path.mid(prefixPath.length()));
+        AppendString<quint16>(out, info.m_etag);
+        AppendBytes<quint8>(out, info.m_contentHash);
+    }
+}
+
+QString ListingIndex::GetIndexPath(const QString& accountName, const QString& containerName)
+{
+    QDir indexDir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/ListingIndex";
+    indexDir.mkpath(QString("."));
+
+    const QByteArray hash = QCryptographicHash::hash(QString("%1/%2").arg(accountName).arg(containerName).toUtf8(), QCryptographicHash::Sha1);
+
+    return indexDir.absoluteFilePath(QString(hash.toHex()) + ".index");
+}
+
+ListingIndex::ListingIndex(const QString& indexPath)
+    : m_indexPath(indexPath)
+{
+    Open();
+}
+
+ListingIndex::~ListingIndex()
+{
+    Save();
+    Close();
+}
+
+void ListingIndex::Open()
+{
+    m_file.setFileName(m_indexPath);
+
+    if (!m_file.open(QIODevice::ReadOnly) || m_file.size() < (qint64)sizeof(s_indexTag))
+        return;
+
+    m_dataSize = m_file.size();
+    m_data = m_file.map(0, m_dataSize);
+
+    if (m_data == nullptr || std::memcmp(m_data, s_indexTag, sizeof(s_indexTag)) != 0)
+    {
+        Close();
+        return;
+    }
+
+    IndexReader reader(m_data, m_dataSize);
+    reader.Skip(sizeof(s_indexTag));
+
+    quint32 numSections = 0;
+    reader.Read(numSections);
+
+    // only the folder names are read here, the items are skipped
+    for (quint32 i = 0; i < numSections; ++i)
+    {
+        QString prefixPath;
+        Section section;
+
+        if (!reader.ReadString<quint32>(prefixPath) || !reader.Read(section.m_numItems) || !reader.Read(section.m_size))
+            break;
+
+        section.m_offset = reader.GetPosition();
+
+        if (!reader.Skip(section.m_size))
+            break;
+
+        m_sections[prefixPath] = section;
+    }
+}
+
+void ListingIndex::Close()
+{
+    m_sections.clear();
+
+    if (m_data != nullptr)
+    {
+        m_file.unmap(const_cast<uchar*>(m_data));
+        m_data = nullptr;
+    }
+
+    m_dataSize = 0;
+    m_file.close();
+}
+
+bool ListingIndex::Get(const QString& prefixPath, std::vector<StorageBlobInfo>& directories, std::vector<StorageBlobInfo>& files)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto updatedIt = m_updated.find(prefixPath);
+    if (updatedIt != m_updated.end())
+    {
+        directories = updatedIt->m_directories;
+        files = updatedIt->m_files;
+        return true;
+    }
+
+    auto sectionIt = m_sections.find(prefixPath);
+    if (sectionIt == m_sections.end())
+        return false;
+
+    IndexReader reader(m_data + sectionIt->m_offset, sectionIt->m_size);
+
+    for (quint32 i = 0; i < sectionIt->m_numItems; ++i)
+    {
+        quint8 isDirectory = 0;
+        StorageBlobInfo info;
+        QString name;
+
+        if (!reader.Read(isDirectory) || !reader.Read(info.m_size) || !reader.Read(info.m_lastModified) || !reader.ReadString<quint16>(name) || !reader.ReadString<quint16>(info.m_etag) || !reader.ReadBytes<quint8>(info.m_contentHash))
+        {
+            // a damaged index is no reason to fail, the live listing will replace it
+            directories.clear();
+            files.clear();
+            return false;
+        }
+
+        info.m_path = prefixPath + name;
+        (isDirectory ? directories : files).push_back(std::move(info));
+    }
+
+    return true;
+}
+
+void ListingIndex::Put(const QString& prefixPath, const std::vector<StorageBlobInfo>& directories, const std::vector<StorageBlobInfo>& files)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Listing& listing = m_updated[prefixPath];
+    listing.m_directories = directories;
+    listing.m_files = files;
+
+    m_modified = true;
+}
+
+void ListingIndex::Invalidate(const QString& path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (qsizetype slash = path.lastIndexOf('/', path.endsWith('/') ? -2 : -1); slash >= 0; slash = (slash > 0) ? path.lastIndexOf('/', slash - 1) : -1)
+    {
+        Remove(path.left(slash + 1));
+    }
+
+    Remove(QString());
+
+    if (!path.endsWith('/'))
+        return;
+
+    for (const QString& prefixPath : m_sections.keys() + m_updated.keys())
+    {
+        if (prefixPath.startsWith(path))
+        {
+            Remove(prefixPath);
+        }
+    }
+}
+
+void ListingIndex::Remove(const QString& prefixPath)
+{
+    if (m_sections.remove(prefixPath) + m_updated.remove(prefixPath) > 0)
+    {
+        m_modified = true;
+    }
+}
+
+bool ListingIndex::Save()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_modified)
+        return true;
+
+    QByteArray out;
+    out.append(s_indexTag, sizeof(s_indexTag));
+
+    QStringList prefixPaths = m_updated.keys();
+    for (auto it = m_sections.begin(); it != m_sections.end(); ++it)
+    {
+        if (!m_updated.contains(it.key()))
+        {
+            prefixPaths.append(it.key());
+        }
+    }
+
+    Append<quint32>(out, (quint32)prefixPaths.size());
+
+    for (const QString& prefixPath : prefixPaths)
+    {
+        AppendString<quint32>(out, prefixPath);
+
+        auto updatedIt = m_updated.find(prefixPath);
+        if (updatedIt != m_updated.end())
+        {
+            QByteArray items;
+            AppendItems(items, prefixPath, updatedIt->m_directories, true);
+            AppendItems(items, prefixPath, updatedIt->m_files, false);
+
+            Append<quint32>(out, (quint32)(updatedIt->m_directories.size() + updatedIt->m_files.size()));
+            Append<quint32>(out, (quint32)items.size());
+            out.append(items);
+        }
+        else
+        {
+            // unchanged folders are copied from the old file as they are
+            const Section& section = m_sections[prefixPath];
+
+            Append<quint32>(out, section.m_numItems);
+            Append<quint32>(out, section.m_size);
+            out.append(reinterpret_cast<const char*>(m_data + section.m_offset), section.m_size);
+        }
+    }
+
+    // the new file is written next to the old one and only replaces it once it is complete, so a crash can't leave a damaged index behind
+    QSaveFile saveFile(m_indexPath);
+    if (!saveFile.open(QIODevice::WriteOnly) || saveFile.write(out) != out.size())
+        return false;
+
+    // the old file can only be replaced once it isn't mapped anymore
+    const QHash<QString, Section> oldSections = m_sections;
+    Close();
+
+    const bool saved = saveFile.commit();
+    Open();
+
+    if (!saved)
+    {
+        // the old file is still in place, but the folders that were invalidated since it was opened must not come back
+        for (const QString& prefixPath : m_sections.keys())
+        {
+            if (!oldSections.contains(prefixPath))
+            {
+                m_sections.remove(prefixPath);
+            }
+        }
+
+        // the updates are kept, so that the next attempt writes them
+        return false;
+    }
+
+    m_updated.clear();
+    m_modified = false;
+    return true;
+}
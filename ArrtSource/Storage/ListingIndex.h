@@ -0,0 +1,71 @@
+#pragma once
+
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <mutex>
+#include <vector>
+
+struct StorageBlobInfo;
+
+/// A local copy of the folder listings of one storage container, which persists across application runs.
+///
+/// The index allows the storage browser to show folders right away, before the live listing has arrived.
+/// Since other tools may change the container at any time, the index can be outdated and has to be revalidated against the live listing.
+///
+/// The index file is memory mapped and only the list of folders is read when it is opened, the items of a folder are decoded when they are requested.
+/// Updated listings are kept in memory until Save() writes a new file.
+class ListingIndex
+{
+public:
+    /// Returns where the index for the given container is stored.
+    static QString GetIndexPath(const QString& accountName, const QString& containerName);
+
+    /// Opens the index file, if it exists.
+    ListingIndex(const QString& indexPath);
+
+    /// Writes back all changes.
+    ~ListingIndex();
+
+    /// Returns the last known listing of the given folder.
+    bool Get(const QString& prefixPath, std::vector<StorageBlobInfo>& directories, std::vector<StorageBlobInfo>& files);
+
+    /// Stores the complete listing of the given folder.
+    void Put(const QString& prefixPath, const std::vector<StorageBlobInfo>& directories, const std::vector<StorageBlobInfo>& files);
+
+    /// Discards all listings that may have changed, when the item at 'path' was created or deleted.
+    ///
+    /// These are the listings of all parent folders of the item, and if the item is a folder (ends with a slash), all listings inside it.
+    void Invalidate(const QString& path);
+
+    /// Writes the index file, if anything has changed.
+    bool Save();
+
+private:
+    /// Where the items of one folder are stored in the mapped file.
+    struct Section
+    {
+        qint64 m_offset = 0;
+        quint32 m_numItems = 0;
+        quint32 m_size = 0;
+    };
+
+    struct Listing
+    {
+        std::vector<StorageBlobInfo> m_directories;
+        std::vector<StorageBlobInfo> m_files;
+    };
+
+    void Open();
+    void Close();
+    void Remove(const QString& prefixPath);
+
+    std::mutex m_mutex;
+    QString m_indexPath;
+    QFile m_file;
+    const uchar* m_data = nullptr;
+    qint64 m_dataSize = 0;
+    QHash<QString, Section> m_sections; ///< The folder listings in the mapped file.
+    QHash<QString, Listing> m_updated;  ///< The folder listings that were stored since the file was opened.
+    bool m_modified = false;
+};
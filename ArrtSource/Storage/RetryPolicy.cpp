@@ -0,0 +1,38 @@
+#include <QRandomGenerator>
+#include <Storage/IncludeAzureStorage.h>
+#include <Storage/RetryPolicy.h>
+#include <algorithm>
+
+static constexpr std::chrono::milliseconds s_initialRetryDelay(2000);
+static constexpr std::chrono::milliseconds s_maxRetryDelay(60000);
+
+bool RetryPolicy::IsTransientError(const std::exception& e)
+{
+    const auto* requestFailed = dynamic_cast<const RequestFailedException*>(&e);
+    if (requestFailed == nullptr)
+        return false;
+
+    if (requestFailed->ErrorCode == "Md5Mismatch" || requestFailed->ErrorCode == "Crc64Mismatch")
+        return true;
+
+    switch (requestFailed->StatusCode)
+    {
+        case Http::HttpStatusCode::None: // no response at all, the connection failed
+        case Http::HttpStatusCode::RequestTimeout:
+        case Http::HttpStatusCode::TooManyRequests:
+        case Http::HttpStatusCode::InternalServerError:
+        case Http::HttpStatusCode::BadGateway:
+        case Http::HttpStatusCode::ServiceUnavailable:
+        case Http::HttpStatusCode::GatewayTimeout:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+std::chrono::milliseconds RetryPolicy::GetRetryDelay(int failedAttempts)
+{
+    const int64_t maxDelay = std::min<int64_t>(s_initialRetryDelay.count() << std::clamp(failedAttempts - 1, 0, 10), s_maxRetryDelay.count());
+    return std::chrono::milliseconds(maxDelay / 2 + (int64_t)QRandomGenerator::global()->bounded((quint64)(maxDelay / 2 + 1)));
+}
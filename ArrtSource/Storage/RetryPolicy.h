@@ -0,0 +1,20 @@
+#pragma once
+
+#include <chrono>
+#include <exception>
+
+/// Decides which failed Azure Storage requests are worth sending again, and how long to wait before that.
+///
+/// This only applies to requests that still fail after the retries of the Storage SDK itself, such as a block of an upload or a range of a download.
+/// The callers park the failed work in a WorkerPool with the delay, instead of waiting on a worker thread.
+class RetryPolicy
+{
+public:
+    /// Whether sending a request again may succeed, because the service was busy, the connection dropped or the data got corrupted on the way.
+    static bool IsTransientError(const std::exception& e);
+
+    /// Returns how long to wait before the request is sent again, after it failed 'failedAttempts' times.
+    ///
+    /// The delay doubles with every failed attempt, up to a limit. A random part keeps all requests that failed at the same time from being sent at the same time again.
+    static std::chrono::milliseconds GetRetryDelay(int failedAttempts);
+};
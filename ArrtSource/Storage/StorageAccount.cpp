@@ -2,15 +2,69 @@
 #include <QJsonObject>
 #include <QPointer>
 #include <QSettings>
+#include <Storage/ListingIndex.h>
 #include <Storage/StorageAccount.h>
+#include <Storage/WorkerPool.h>
 #include <Utils/Logging.h>
+#include <algorithm>
+#include <future>
+
+// a few listings in parallel keep the browser responsive, when multiple folders are expanded at once
+static constexpr int s_maxParallelListings = 4;
+
+// the blob batch API accepts at most 256 sub-requests per batch
+static constexpr size_t s_maxBlobsPerBatch = 256;
+
+// copies mostly wait for the server, so many of them can be in flight
+static constexpr int s_maxParallelBlobTasks = 16;
+static constexpr std::chrono::milliseconds s_copyPollInterval(500);
+
+// how long the source of a copy stays readable, counted from when the copy of that item starts
+static constexpr std::chrono::minutes s_copySasDuration(60);
+
+static bool IsEmptyFolderDummy(const BlobItem& blob)
+{
+    return QString::fromStdString(blob.Name).endsWith(".EmptyFolderDummy");
+}
+
+static StorageBlobInfo ToBlobInfo(const BlobItem& blob)
+{
+    StorageBlobInfo info;
+    info.m_path = blob.Name.c_str();
+    info.m_size = blob.BlobSize;
+    info.m_lastModified = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::time_point(blob.Details.LastModified).time_since_epoch()).count();
+    info.m_etag = QString::fromStdString(blob.Details.ETag.ToString());
+
+    const auto& hash = blob.Details.HttpHeaders.ContentHash;
+    if (hash.Algorithm == HashAlgorithm::Md5)
+    {
+        info.m_contentHash = QByteArray(reinterpret_cast<const char*>(hash.Value.data()), (qsizetype)hash.Value.size());
+    }
+
+    return info;
+}
 
 StorageAccount::StorageAccount(FileUploader::UpdateCallback uploadCallback)
 {
     m_fileUploader = std::make_unique<FileUploader>(uploadCallback, this);
+    m_fileDownloader = std::make_unique<FileDownloader>(this);
+    m_blobJobWorkers = std::make_unique<WorkerPool>(s_maxParallelBlobTasks);
+    m_listingWorkers = std::make_unique<WorkerPool>(s_maxParallelListings);
 }
 
-StorageAccount::~StorageAccount() = default;
+StorageAccount::~StorageAccount()
+{
+    // running listings don't need to wait for their next page anymore
+    m_listingContext.Cancel();
+
+    // the upload and download workers use the storage client, so they have to stop first
+    m_fileUploader = nullptr;
+    m_fileDownloader = nullptr;
+    m_listingWorkers = nullptr;
+    m_blobJobWorkers = nullptr;
+
+    CloseListingIndices();
+}
 
 bool StorageAccount::LoadSettings()
 {
@@ -19,6 +73,9 @@ bool StorageAccount::LoadSettings()
     m_accountName = s.value("AccountName").toString();
     m_accountKey = s.value("AccountKey").toString();
     m_endpointUrl = s.value("EndpointUrl").toString();
+    m_listingCache.SetMemoryBudget(s.value("ListingCacheMemoryBudget", m_listingCache.GetMemoryBudget()).toLongLong());
+    m_listingCache.SetTimeToLive(std::chrono::seconds(s.value("ListingCacheTimeToLive", (qlonglong)m_listingCache.GetTimeToLive().count()).toLongLong()));
+    m_useListingIndex = s.value("UseListingIndex", true).toBool();
     s.endGroup();
 
     SanitizeSettings(m_accountName, m_accountKey, m_endpointUrl);
@@ -33,6 +90,9 @@ void StorageAccount::SaveSettings() const
     s.setValue("AccountName", m_accountName);
     s.setValue("AccountKey", m_accountKey);
     s.setValue("EndpointUrl", m_endpointUrl);
+    s.setValue("ListingCacheMemoryBudget", (qlonglong)m_listingCache.GetMemoryBudget());
+    s.setValue("ListingCacheTimeToLive", (qlonglong)m_listingCache.GetTimeToLive().count());
+    s.setValue("UseListingIndex", m_useListingIndex);
     s.endGroup();
 }
 
@@ -146,10 +206,40 @@ void StorageAccount::DisconnectFromStorageAccount()
 {
     SetConnectionStatus(StorageConnectionStatus::NotAuthenticated);
 
+    // uploads and downloads can't continue with a different account, and the workers must not use the client while it gets replaced
+    if (m_fileUploader)
+    {
+        m_fileUploader->CancelAllUploads(true);
+    }
+
+    if (m_fileDownloader)
+    {
+        m_fileDownloader->CancelAllDownloads(true);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_blobJobsMutex);
+
+        for (const auto& weakJob : m_blobJobs)
+        {
+            if (auto job = weakJob.lock())
+            {
+                job->Cancel();
+            }
+        }
+
+        m_blobJobs.clear();
+    }
+
+    // listings of the old account are aborted, later listings get a fresh context
+    m_listingContext.Cancel();
+    m_listingContext = Azure::Core::Context();
+
     m_azStorageServiceClient = nullptr;
     m_azStorageCredentials = nullptr;
 
     ClearCache();
+    CloseListingIndices();
 }
 
 bool StorageAccount::CreateContainer(const QString& containerName, QString& errorMsg)
@@ -211,41 +301,377 @@ bool StorageAccount::DeleteItem(const QString& containerName, const QString& pat
         return false;
     }
 
+    if (path.endsWith("/"))
+    {
+        std::promise<BlobJobProgress> done;
+        std::future<BlobJobProgress> result = done.get_future();
+
+        DeleteFolderAsync(containerName, path, [&done](const BlobJobProgress& progress)
+                          {
+                              if (progress.m_finished)
+                              {
+                                  done.set_value(progress);
+                              } });
+
+        const BlobJobProgress progress = result.get();
+
+        if (progress.m_failedBlobs > 0)
+        {
+            errorMsg = QString("%1 of %2 files could not be deleted:\n%3").arg(progress.m_failedBlobs).arg(progress.m_foundBlobs).arg(progress.m_failures.join("\n"));
+            return false;
+        }
+
+        if (progress.m_listingFailed)
+        {
+            errorMsg = "The folder could not be listed completely.";
+            return false;
+        }
+
+        return true;
+    }
+
     try
     {
         auto container = GetStorageContainerFromName(containerName);
 
-        if (path.endsWith("/"))
+        auto res = container.DeleteBlob(path.toStdString());
+        if (res.Value.Deleted == false)
         {
-            ListBlobsOptions opt;
-            opt.Prefix = path.toStdString();
-            auto subs = container.ListBlobs(opt);
+            errorMsg = QString("Deletion failed: ") + res.RawResponse->GetReasonPhrase().c_str();
+            return false;
+        }
 
-            for (const auto& sub : subs.Blobs)
-            {
-                container.DeleteBlob(sub.Name);
-            }
+        InvalidateCache(containerName, path);
+        return true;
+    }
+    catch (std::exception& e)
+    {
+        errorMsg = e.what();
+    }
+
+    return false;
+}
+
+std::shared_ptr<BlobJob> StorageAccount::DeleteFolderAsync(const QString& containerName, const QString& path, BlobJob::ProgressCallback progressCallback)
+{
+    // the listings are outdated as soon as the first blob is gone, but reading them again only makes sense once all are gone
+    // the workers are stopped before anything else is destroyed, so using 'this' is fine
+    auto job = std::make_shared<BlobJob>([this, containerName, path, progressCallback = std::move(progressCallback)](const BlobJobProgress& progress)
+                                           {
+                                               if (progress.m_finished)
+                                               {
+                                                   InvalidateCache(containerName, path);
+                                               }
+
+                                               progressCallback(progress); });
+
+    if (m_azStorageServiceClient == nullptr || m_listingWorkers == nullptr || !path.endsWith("/"))
+    {
+        job->FinishListing(false);
+        return job;
+    }
+
+    AddBlobJob(job);
+
+    m_listingWorkers->AddJob(0, [workers = m_blobJobWorkers.get(), container = GetStorageContainerFromName(containerName), containerName, path, job]()
+                             {
+                                 bool success = true;
+
+                                 try
+                                 {
+                                     ListBlobsOptions opt;
+                                     opt.Prefix = path.toStdString();
+
+                                     // the batches of one page are deleted while the next page is being listed
+                                     for (auto page = container.ListBlobs(opt, job->GetContext()); page.HasPage() && !job->IsCancelled(); page.MoveToNextPage(job->GetContext()))
+                                     {
+                                         const size_t numBlobs = page.Blobs.size();
+                                         const int numBatches = (int)((numBlobs + s_maxBlobsPerBatch - 1) / s_maxBlobsPerBatch);
+
+                                         int64_t numBytes = 0;
+                                         for (const auto& blob : page.Blobs)
+                                         {
+                                             numBytes += blob.BlobSize;
+                                         }
+
+                                         job->AddFoundBlobs((int64_t)numBlobs, numBytes, numBatches);
+
+                                         for (size_t first = 0; first < numBlobs; first += s_maxBlobsPerBatch)
+                                         {
+                                             std::vector<BlobItem> blobs(page.Blobs.begin() + first, page.Blobs.begin() + std::min(first + s_maxBlobsPerBatch, numBlobs));
+
+                                             workers->AddJob(0, [container, containerName, job, blobs = std::move(blobs)]()
+                                                                   { DeleteBlobBatch(container, containerName, *job, blobs); });
+                                         }
+                                     }
+                                 }
+                                 catch (const std::exception& e)
+                                 {
+                                     // a cancelled listing throws as well, but that isn't a failure
+                                     success = job->IsCancelled();
+
+                                     if (!success)
+                                     {
+                                         qWarning(LoggingCategory::AzureStorage)
+                                             << "Listing folder for deletion failed."
+                                             << "\n  Container: " << containerName
+                                             << "\n  Folder: " << path
+                                             << "\n  Msg: " << e.what();
+                                     }
+                                 }
+
+                                 job->FinishListing(success); });
+
+    return job;
+}
+
+std::shared_ptr<BlobJob> StorageAccount::CopyItemAsync(const QString& srcContainerName, const QString& srcPath, const QString& dstContainerName, const QString& dstPath, bool move, BlobJob::ProgressCallback progressCallback)
+{
+    auto job = std::make_shared<BlobJob>([this, srcContainerName, srcPath, dstContainerName, dstPath, move, progressCallback = std::move(progressCallback)](const BlobJobProgress& progress)
+                                         {
+                                             if (progress.m_finished)
+                                             {
+                                                 InvalidateCache(dstContainerName, dstPath);
+
+                                                 if (move)
+                                                 {
+                                                     InvalidateCache(srcContainerName, srcPath);
+                                                 }
+                                             }
+
+                                             progressCallback(progress); });
+
+    const bool isFolder = srcPath.endsWith("/");
+    const bool sameContainer = (srcContainerName == dstContainerName);
+
+    // copying a folder into itself would never end, since the listing would find the copies as well
+    // and moving an item onto itself would delete it
+    if (m_azStorageServiceClient == nullptr || m_listingWorkers == nullptr || srcPath.isEmpty() || isFolder != dstPath.endsWith("/") || (sameContainer && (srcPath == dstPath || (isFolder && dstPath.startsWith(srcPath)))))
+    {
+        job->FinishListing(false);
+        return job;
+    }
+
+    AddBlobJob(job);
+
+    // every copy creates its own short-lived SAS for the source once it starts, items that wait in a large folder copy would outlive a shared one
+    m_listingWorkers->AddJob(0, [workers = m_blobJobWorkers.get(), srcContainer = GetStorageContainerFromName(srcContainerName), dstContainer = GetStorageContainerFromName(dstContainerName), credentials = m_azStorageCredentials, srcContainerName, srcPath, dstPath, isFolder, move, job]()
+                             {
+                                 auto queueCopy = [&](const BlobItem& blob, const QString& blobDstPath)
+                                 {
+                                     workers->AddJob(0, [srcContainer, dstContainer, credentials, srcContainerName, blob, blobDstPath, move, job]()
+                                                     { CopyBlob(srcContainer, dstContainer, *credentials, srcContainerName, blob, blobDstPath, move, *job); });
+                                 };
+
+                                 bool success = true;
+
+                                 try
+                                 {
+                                     if (!isFolder)
+                                     {
+                                         // the size is only needed for the progress
+                                         auto properties = srcContainer.GetBlobClient(srcPath.toStdString()).GetProperties(GetBlobPropertiesOptions(), job->GetContext());
+
+                                         BlobItem blob;
+                                         blob.Name = srcPath.toStdString();
+                                         blob.BlobSize = properties.Value.BlobSize;
+
+                                         job->AddFoundBlobs(1, blob.BlobSize, 1);
+                                         queueCopy(blob, dstPath);
+                                     }
+                                     else
+                                     {
+                                         ListBlobsOptions opt;
+                                         opt.Prefix = srcPath.toStdString();
+
+                                         // the empty folder dummy files are copied as well, so that empty folders survive the move
+                                         for (auto page = srcContainer.ListBlobs(opt, job->GetContext()); page.HasPage() && !job->IsCancelled(); page.MoveToNextPage(job->GetContext()))
+                                         {
+                                             int64_t numBytes = 0;
+                                             for (const auto& blob : page.Blobs)
+                                             {
+                                                 numBytes += blob.BlobSize;
+                                             }
+
+                                             job->AddFoundBlobs((int64_t)page.Blobs.size(), numBytes, (int)page.Blobs.size());
+
+                                             for (const auto& blob : page.Blobs)
+                                             {
+                                                 queueCopy(blob, dstPath + QString::fromStdString(blob.Name).mid(srcPath.length()));
+                                             }
+                                         }
+                                     }
+                                 }
+                                 catch (const std::exception& e)
+                                 {
+                                     success = job->IsCancelled();
+
+                                     if (!success)
+                                     {
+                                         qWarning(LoggingCategory::AzureStorage)
+                                             << "Listing items for copying failed."
+                                             << "\n  Container: " << srcContainerName
+                                             << "\n  Path: " << srcPath
+                                             << "\n  Msg: " << e.what();
+                                     }
+                                 }
+
+                                 job->FinishListing(success); });
+
+    return job;
+}
+
+void StorageAccount::CopyBlob(const BlobContainerClient& srcContainer, const BlobContainerClient& dstContainer, const StorageSharedKeyCredential& credentials, const QString& srcContainerName, const BlobItem& blob, const QString& dstPath, bool move, BlobJob& job)
+{
+    QStringList failures;
+
+    if (job.IsCancelled())
+    {
+        job.FinishTask(0, 0, failures);
+        return;
+    }
+
+    const QString srcPath = QString::fromStdString(blob.Name);
+
+    try
+    {
+        Azure::Core::Context context = job.GetContext();
+
+        auto srcBlob = srcContainer.GetBlobClient(blob.Name);
+        auto dstBlob = dstContainer.GetBlobClient(dstPath.toStdString());
+
+        // the destination reads the source through a SAS, so the copy works across containers
+        // it only needs to read this one blob, for as long as the copy may take
+        BlobSasBuilder sb;
+        sb.Protocol = SasProtocol::HttpsAndHttp;
+        sb.BlobContainerName = srcContainerName.toStdString();
+        sb.BlobName = blob.Name;
+        sb.ExpiresOn = Azure::DateTime(std::chrono::system_clock::now() + s_copySasDuration);
+        sb.Resource = BlobSasResource::Blob;
+        sb.SetPermissions(BlobSasPermissions::Read);
+
+        std::string sourceSas = sb.GenerateSasToken(credentials);
+        if (!sourceSas.empty() && sourceSas[0] == '?')
+        {
+            sourceSas.erase(0, 1);
+        }
+
+        // within the same account the server usually finishes a copy right away, large copies across accounts may take a while
+        auto operation = dstBlob.StartCopyFromUri(srcBlob.GetUrl() + "?" + sourceSas, StartBlobCopyFromUriOptions(), context);
+        const auto properties = operation.PollUntilDone(s_copyPollInterval, context);
+
+        if (properties.Value.CopyStatus.HasValue() && properties.Value.CopyStatus.Value() != Blobs::Models::CopyStatus::Success)
+        {
+            failures.append(QString("%1: The copy ended with status '%2'.").arg(srcPath).arg(QString::fromStdString(properties.Value.CopyStatus.Value().ToString())));
         }
         else
         {
-            auto res = container.DeleteBlob(path.toStdString());
-            if (res.Value.Deleted == false)
+            // the source is only removed once the copy is complete, so a failed move never loses data
+            if (move)
             {
-                errorMsg = QString("Deletion failed: ") + res.RawResponse->GetReasonPhrase().c_str();
-                return false;
+                srcBlob.Delete(DeleteBlobOptions(), context);
             }
+
+            job.FinishTask(1, blob.BlobSize, failures);
+            return;
         }
+    }
+    catch (const std::exception& e)
+    {
+        if (!job.IsCancelled())
+        {
+            failures.append(QString("%1: %2").arg(srcPath).arg(e.what()));
 
-        // TODO: wouldn't need to clear the entire cache
-        ClearCache();
-        return true;
+            qWarning(LoggingCategory::AzureStorage)
+                << "Copying blob failed."
+                << "\n  Src: " << srcPath
+                << "\n  Dst: " << dstPath
+                << "\n  Msg: " << e.what();
+        }
     }
-    catch (std::exception& e)
+
+    job.FinishTask(0, 0, failures);
+}
+
+void StorageAccount::AddBlobJob(const std::shared_ptr<BlobJob>& job)
+{
+    std::lock_guard<std::mutex> lock(m_blobJobsMutex);
+
+    m_blobJobs.erase(std::remove_if(m_blobJobs.begin(), m_blobJobs.end(), [](const std::weak_ptr<BlobJob>& existing)
+                                    { return existing.expired(); }),
+                     m_blobJobs.end());
+
+    m_blobJobs.push_back(job);
+}
+
+void StorageAccount::DeleteBlobBatch(const BlobContainerClient& container, const QString& containerName, BlobJob& job, const std::vector<BlobItem>& blobs)
+{
+    int64_t deletedBlobs = 0;
+    int64_t deletedBytes = 0;
+    QStringList failures;
+
+    if (job.IsCancelled())
     {
-        errorMsg = e.what();
+        job.FinishTask(0, 0, failures);
+        return;
     }
 
-    return false;
+    try
+    {
+        BlobContainerBatch batch = container.CreateBatch();
+
+        std::vector<DeferredResponse<Blobs::Models::DeleteBlobResult>> responses;
+        responses.reserve(blobs.size());
+
+        for (const BlobItem& blob : blobs)
+        {
+            responses.push_back(batch.DeleteBlob(blob.Name));
+        }
+
+        container.SubmitBatch(batch, SubmitBlobBatchOptions(), job.GetContext());
+
+        // every sub-request succeeds or fails on its own
+        for (size_t i = 0; i < responses.size(); ++i)
+        {
+            try
+            {
+                responses[i].GetResponse();
+                ++deletedBlobs;
+                deletedBytes += blobs[i].BlobSize;
+            }
+            catch (const StorageException& e)
+            {
+                // the blob is gone either way
+                if (e.StatusCode == Azure::Core::Http::HttpStatusCode::NotFound)
+                {
+                    ++deletedBlobs;
+                    deletedBytes += blobs[i].BlobSize;
+                    continue;
+                }
+
+                failures.append(QString("%1: %2").arg(QString::fromStdString(blobs[i].Name)).arg(QString::fromStdString(e.ReasonPhrase)));
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        // when the job was cancelled, the remaining blobs just weren't deleted, that isn't a failure
+        if (!job.IsCancelled())
+        {
+            for (const BlobItem& blob : blobs)
+            {
+                failures.append(QString("%1: %2").arg(QString::fromStdString(blob.Name)).arg(e.what()));
+            }
+
+            qWarning(LoggingCategory::AzureStorage)
+                << "Deleting a batch of blobs failed."
+                << "\n  Container: " << containerName
+                << "\n  Blobs: " << blobs.size()
+                << "\n  Msg: " << e.what();
+        }
+    }
+
+    job.FinishTask(deletedBlobs, deletedBytes, failures);
 }
 
 bool StorageAccount::CreateTextItem(const QString& containerName, const QString& path, const QString& content, QString& errorMsg)
@@ -262,8 +688,7 @@ bool StorageAccount::CreateTextItem(const QString& containerName, const QString&
 
         container.UploadBlob(path.toStdString(), stream);
 
-        // TODO: wouldn't need to clear the entire cache
-        ClearCache();
+        InvalidateCache(containerName, path);
 
         return true;
     }
@@ -292,52 +717,270 @@ void StorageAccount::ListBlobDirectory(const QString& containerName, const QStri
     if (m_azStorageServiceClient == nullptr)
         return;
 
-    const QString cacheKey = containerName + "##" + prefixPath;
+    ListBlobPages(GetStorageContainerFromName(containerName), containerName, prefixPath, QString(), true, FindListingIndex(containerName), m_listingContext, [&](const std::vector<StorageBlobInfo>& pageDirectories, const std::vector<StorageBlobInfo>& pageFiles, const QString&)
+                  {
+                      directories.insert(directories.end(), pageDirectories.begin(), pageDirectories.end());
+                      files.insert(files.end(), pageFiles.begin(), pageFiles.end());
+                      return true; });
+}
+
+bool StorageAccount::ListBlobDirectoryPaged(const QString& containerName, const QString& prefixPath, const QString& continuationToken, const ListBlobPageCallback& callback) const
+{
+    if (m_azStorageServiceClient == nullptr)
+        return false;
+
+    return ListBlobPages(GetStorageContainerFromName(containerName), containerName, prefixPath, continuationToken, false, FindListingIndex(containerName), m_listingContext, callback);
+}
 
-    auto cacheIt = m_cachedBlobs.find(cacheKey);
-    if (cacheIt != m_cachedBlobs.end())
+void StorageAccount::ListBlobDirectoryPagedAsync(const QString& containerName, const QString& prefixPath, const QString& continuationToken, bool useCache, ListBlobPageCallback pageCallback, std::function<void(bool success)> finishedCallback)
+{
+    if (m_azStorageServiceClient == nullptr || m_listingWorkers == nullptr)
     {
-        directories = cacheIt->second.m_directories;
-        files = cacheIt->second.m_files;
+        finishedCallback(false);
         return;
     }
 
-    auto container = GetStorageContainerFromName(containerName);
+    // the container client is a self-contained copy, so the listing isn't affected when the account gets disconnected in the meantime
+    // the workers are stopped before the cache is destroyed, so using 'this' is fine
+    m_listingWorkers->AddJob(0, [this, container = GetStorageContainerFromName(containerName), index = GetListingIndex(containerName), context = m_listingContext, containerName, prefixPath, continuationToken, useCache, pageCallback = std::move(pageCallback), finishedCallback = std::move(finishedCallback)]()
+                             {
+                                 const bool success = ListBlobPages(container, containerName, prefixPath, continuationToken, useCache, index, context, pageCallback);
+                                 finishedCallback(success); });
+}
+
+bool StorageAccount::ListBlobsRecursive(const QString& containerName, const QString& prefixPath, const ListBlobPageCallback& callback) const
+{
+    if (m_azStorageServiceClient == nullptr)
+        return false;
+
+    return ListFlatBlobPages(GetStorageContainerFromName(containerName), containerName, prefixPath, m_listingContext, callback);
+}
+
+void StorageAccount::ListBlobsRecursiveAsync(const QString& containerName, const QString& prefixPath, ListBlobPageCallback pageCallback, std::function<void(bool success)> finishedCallback)
+{
+    if (m_azStorageServiceClient == nullptr || m_listingWorkers == nullptr)
+    {
+        finishedCallback(false);
+        return;
+    }
 
-    ListBlobsOptions opt;
-    opt.Prefix = prefixPath.toStdString();
-    auto res = container.ListBlobsByHierarchy("/", opt);
+    m_listingWorkers->AddJob(0, [container = GetStorageContainerFromName(containerName), context = m_listingContext, containerName, prefixPath, pageCallback = std::move(pageCallback), finishedCallback = std::move(finishedCallback)]()
+                             {
+                                 const bool success = ListFlatBlobPages(container, containerName, prefixPath, context, pageCallback);
+                                 finishedCallback(success); });
+}
 
-    for (const auto& blob : res.Blobs)
+bool StorageAccount::ListFlatBlobPages(const BlobContainerClient& container, const QString& containerName, const QString& prefixPath, const Azure::Core::Context& context, const ListBlobPageCallback& callback)
+{
+    try
     {
-        StorageBlobInfo info;
-        info.m_path = blob.Name.c_str();
-        // info.m_uri = needed ??
+        ListBlobsOptions opt;
+        opt.Prefix = prefixPath.toStdString();
+
+        // without a delimiter, every page contains files from any depth, and there are no folders
+        const std::vector<StorageBlobInfo> noDirectories;
 
-        // skip our own empty folder dummy files
-        if (!info.m_path.endsWith(".EmptyFolderDummy"))
+        for (auto page = container.ListBlobs(opt, context); page.HasPage() && !context.IsCancelled(); page.MoveToNextPage(context))
         {
-            files.push_back(info);
+            std::vector<StorageBlobInfo> files;
+            files.reserve(page.Blobs.size());
+
+            for (const auto& blob : page.Blobs)
+            {
+                if (!IsEmptyFolderDummy(blob))
+                {
+                    files.push_back(ToBlobInfo(blob));
+                }
+            }
+
+            const QString nextToken = page.NextPageToken.HasValue() ? QString::fromStdString(page.NextPageToken.Value()) : QString();
+
+            if (!callback(noDirectories, files, nextToken))
+                break;
         }
+
+        return !context.IsCancelled();
+    }
+    catch (const std::exception& e)
+    {
+        qWarning(LoggingCategory::AzureStorage)
+            << "Listing storage blobs failed."
+            << "\n  Container: " << containerName
+            << "\n  Prefix: " << prefixPath
+            << "\n  Msg: " << e.what();
     }
 
-    for (const auto& blob : res.BlobPrefixes)
+    return false;
+}
+
+bool StorageAccount::ListBlobPages(const BlobContainerClient& container, const QString& containerName, const QString& prefixPath, const QString& continuationToken, bool useCache, const std::shared_ptr<ListingIndex>& index, const Azure::Core::Context& context, const ListBlobPageCallback& callback) const
+{
+    // the cache only holds complete listings, so it can only answer requests for the first page
+    if (continuationToken.isEmpty())
     {
-        StorageBlobInfo info;
-        info.m_path = blob.c_str();
-        // info.m_uri = needed ??
+        std::vector<StorageBlobInfo> directories, files;
 
-        directories.push_back(info);
+        if (useCache && m_listingCache.Get(containerName, prefixPath, directories, files))
+        {
+            callback(directories, files, QString());
+            return true;
+        }
     }
 
-    auto& cached = m_cachedBlobs[cacheKey];
-    cached.m_directories = directories;
-    cached.m_files = files;
+    try
+    {
+        ListBlobsOptions opt;
+        opt.Prefix = prefixPath.toStdString();
+
+        if (!continuationToken.isEmpty())
+        {
+            opt.ContinuationToken = continuationToken.toStdString();
+        }
+
+        // collects the complete listing for the cache, as long as the callback doesn't stop early
+        bool complete = continuationToken.isEmpty();
+        std::vector<StorageBlobInfo> allDirectories, allFiles;
+
+        for (auto page = container.ListBlobsByHierarchy("/", opt, context); page.HasPage() && !context.IsCancelled(); page.MoveToNextPage(context))
+        {
+            std::vector<StorageBlobInfo> directories, files;
+            directories.reserve(page.BlobPrefixes.size());
+            files.reserve(page.Blobs.size());
+
+            for (const auto& blob : page.Blobs)
+            {
+                // skip our own empty folder dummy files
+                if (!IsEmptyFolderDummy(blob))
+                {
+                    files.push_back(ToBlobInfo(blob));
+                }
+            }
+
+            for (const auto& blob : page.BlobPrefixes)
+            {
+                StorageBlobInfo info;
+                info.m_path = blob.c_str();
+
+                directories.push_back(info);
+            }
+
+            if (complete)
+            {
+                allDirectories.insert(allDirectories.end(), directories.begin(), directories.end());
+                allFiles.insert(allFiles.end(), files.begin(), files.end());
+            }
+
+            const QString nextToken = page.NextPageToken.HasValue() ? QString::fromStdString(page.NextPageToken.Value()) : QString();
+
+            if (!callback(directories, files, nextToken))
+            {
+                complete = complete && nextToken.isEmpty();
+                break;
+            }
+        }
+
+        // a cancelled listing stops between pages, what was listed so far must not end up in the cache
+        if (context.IsCancelled())
+            return false;
+
+        if (complete)
+        {
+            m_listingCache.Put(containerName, prefixPath, allDirectories, allFiles);
+
+            if (index)
+            {
+                index->Put(prefixPath, allDirectories, allFiles);
+            }
+        }
+
+        return true;
+    }
+    catch (const std::exception& e)
+    {
+        qWarning(LoggingCategory::AzureStorage)
+            << "Listing storage folder failed."
+            << "\n  Container: " << containerName
+            << "\n  Folder: " << prefixPath
+            << "\n  Msg: " << e.what();
+    }
+
+    return false;
 }
 
 void StorageAccount::ClearCache()
 {
-    m_cachedBlobs.clear();
+    m_listingCache.Clear();
+}
+
+void StorageAccount::InvalidateCache(const QString& containerName, const QString& path)
+{
+    m_listingCache.Invalidate(containerName, path);
+
+    if (auto index = FindListingIndex(containerName))
+    {
+        index->Invalidate(path);
+    }
+}
+
+void StorageAccount::SetUseListingIndex(bool enable)
+{
+    if (m_useListingIndex == enable)
+        return;
+
+    m_useListingIndex = enable;
+
+    if (!enable)
+    {
+        CloseListingIndices();
+    }
+}
+
+bool StorageAccount::GetIndexedListing(const QString& containerName, const QString& prefixPath, std::vector<StorageBlobInfo>& directories, std::vector<StorageBlobInfo>& files) const
+{
+    if (auto index = GetListingIndex(containerName))
+    {
+        return index->Get(prefixPath, directories, files);
+    }
+
+    return false;
+}
+
+std::shared_ptr<ListingIndex> StorageAccount::GetListingIndex(const QString& containerName) const
+{
+    if (!m_useListingIndex || m_accountName.isEmpty() || containerName.isEmpty())
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(m_listingIndicesMutex);
+
+    auto& index = m_listingIndices[containerName];
+
+    if (index == nullptr)
+    {
+        index = std::make_shared<ListingIndex>(ListingIndex::GetIndexPath(m_accountName, containerName));
+    }
+
+    return index;
+}
+
+std::shared_ptr<ListingIndex> StorageAccount::FindListingIndex(const QString& containerName) const
+{
+    std::lock_guard<std::mutex> lock(m_listingIndicesMutex);
+
+    auto it = m_listingIndices.find(containerName);
+    return (it != m_listingIndices.end()) ? it->second : nullptr;
+}
+
+void StorageAccount::CloseListingIndices()
+{
+    std::map<QString, std::shared_ptr<ListingIndex>> indices;
+
+    {
+        std::lock_guard<std::mutex> lock(m_listingIndicesMutex);
+        indices.swap(m_listingIndices);
+    }
+
+    // every index writes its changes when it is destroyed, if a background listing still uses one, that happens once the listing is done
+    indices.clear();
 }
 
 Azure::Storage::Blobs::BlobContainerClient StorageAccount::GetStorageContainerFromName(const QString& containerName) const
@@ -1,8 +1,15 @@
 #pragma once
 
 #include <QObject>
+#include <Storage/BlobJob.h>
+#include <Storage/FileDownloader.h>
 #include <Storage/FileUploader.h>
 #include <Storage/IncludeAzureStorage.h>
+#include <Storage/ListingCache.h>
+#include <mutex>
+
+class ListingIndex;
+class WorkerPool;
 
 enum class StorageConnectionStatus
 {
@@ -16,8 +23,18 @@ enum class StorageConnectionStatus
 struct StorageBlobInfo
 {
     QString m_path;
+    int64_t m_size = 0;         ///< The size of a file in bytes, zero for folders.
+    int64_t m_lastModified = 0; ///< When a file was last modified, in seconds since the epoch. Zero for folders.
+    QString m_etag;             ///< Changes whenever a file is modified, empty for folders.
+    QByteArray m_contentHash;   ///< The MD5 hash of a file, if it was set during the upload. Empty for folders.
 };
 
+/// Receives one page of a directory listing.
+///
+/// 'continuationToken' allows to continue the listing with the next page later, it is empty when this was the last page.
+/// Return false to stop the listing after this page.
+using ListBlobPageCallback = std::function<bool(const std::vector<StorageBlobInfo>& directories, const std::vector<StorageBlobInfo>& files, const QString& continuationToken)>;
+
 
 /// Manages all interactions with the Azure Storage account.
 class StorageAccount : public QObject
@@ -33,6 +50,7 @@ public:
     virtual ~StorageAccount();
 
     FileUploader* GetFileUploader() { return m_fileUploader.get(); }
+    FileDownloader* GetFileDownloader() { return m_fileDownloader.get(); }
 
 
     /// Retrieves the last used connection settings.
@@ -91,9 +109,26 @@ public:
 
     /// Attempts to delete a file or folder.
     ///
+    /// Folders (paths ending with a slash) are deleted through DeleteFolderAsync(), but this function blocks until it is done.
     /// In case of failure, 'errorMsg' provides some details.
     bool DeleteItem(const QString& containerName, const QString& path, QString& errorMsg);
 
+    /// Deletes all files inside the given folder (the path must end with a slash) in the background.
+    ///
+    /// The folder is listed page by page and the files of every page are deleted with blob batch requests,
+    /// several of which run in parallel. 'progressCallback' is called on a background thread, whenever a page was listed
+    /// or a batch has finished, the last call has BlobJobProgress::m_finished set.
+    std::shared_ptr<BlobJob> DeleteFolderAsync(const QString& containerName, const QString& path, BlobJob::ProgressCallback progressCallback);
+
+    /// Copies or moves a file or folder in the background. The data is copied by the server, nothing is downloaded.
+    ///
+    /// If 'srcPath' is a folder (ends with a slash), 'dstPath' has to be a folder as well, and all files inside are copied with their relative paths.
+    /// Otherwise 'dstPath' is the path of the new file. Existing files at the destination are overwritten.
+    /// Many copies are in flight at the same time, each one is polled until the server has finished it.
+    /// If 'move' is true, every source file is deleted as soon as its copy has succeeded, so a rename is a move within the same folder.
+    /// 'progressCallback' is called on a background thread, the last call has BlobJobProgress::m_finished set.
+    std::shared_ptr<BlobJob> CopyItemAsync(const QString& srcContainerName, const QString& srcPath, const QString& dstContainerName, const QString& dstPath, bool move, BlobJob::ProgressCallback progressCallback);
+
     /// Attempts to create a text file in the given container and with the given path and content.
     ///
     /// In case of failure, 'errorMsg' provides some details.
@@ -105,11 +140,53 @@ public:
     /// Lists all files and folders that exist inside the given storage container and sub-path.
     ///
     /// This is not recursive, only the next level of items is returned.
+    /// All pages of the listing are retrieved before this returns, use ListBlobDirectoryPaged() for very large folders.
     void ListBlobDirectory(const QString& containerName, const QString& prefixPath, std::vector<StorageBlobInfo>& directories, std::vector<StorageBlobInfo>& files) const;
 
+    /// Lists the files and folders inside the given storage container and sub-path, one page at a time.
+    ///
+    /// Every page is passed to 'callback' as soon as it has arrived. The callback can stop the listing early by returning false,
+    /// and the listing can be continued later, by passing the last continuation token back in.
+    /// Returns false if the listing failed.
+    bool ListBlobDirectoryPaged(const QString& containerName, const QString& prefixPath, const QString& continuationToken, const ListBlobPageCallback& callback) const;
+
+    /// Same as ListBlobDirectoryPaged(), but the listing runs on a background thread and this function returns immediately.
+    ///
+    /// Both callbacks are executed on the background thread. 'finishedCallback' is always called last, with whether the listing succeeded.
+    /// If 'useCache' is true and a cached listing of the folder is available, it is delivered as a single page instead.
+    /// Complete listings are stored in the cache either way.
+    void ListBlobDirectoryPagedAsync(const QString& containerName, const QString& prefixPath, const QString& continuationToken, bool useCache, ListBlobPageCallback pageCallback, std::function<void(bool success)> finishedCallback);
+
+    /// Lists all files inside the given storage container whose path starts with 'prefixPath', no matter how deeply nested they are.
+    ///
+    /// This is a flat listing, it needs one request per page instead of one per folder. The 'directories' passed to 'callback' are always empty.
+    /// The callback can stop the listing early by returning false. Returns false if the listing failed.
+    /// The result isn't cached, since it doesn't correspond to the content of a single folder.
+    bool ListBlobsRecursive(const QString& containerName, const QString& prefixPath, const ListBlobPageCallback& callback) const;
+
+    /// Same as ListBlobsRecursive(), but the listing runs on a background thread and this function returns immediately.
+    ///
+    /// Both callbacks are executed on the background thread. 'finishedCallback' is always called last, with whether the listing succeeded.
+    void ListBlobsRecursiveAsync(const QString& containerName, const QString& prefixPath, ListBlobPageCallback pageCallback, std::function<void(bool success)> finishedCallback);
+
     /// Clears the cached information about files and folders.
     void ClearCache();
 
+    /// Discards the cached information that is affected by creating or deleting the item at 'path'. Can be called from any thread.
+    void InvalidateCache(const QString& containerName, const QString& path);
+
+    /// Enables or disables the local listing index, which stores folder listings across application runs (see ListingIndex).
+    void SetUseListingIndex(bool enable);
+
+    /// Returns whether the local listing index is used.
+    bool GetUseListingIndex() const { return m_useListingIndex; }
+
+    /// Returns the last known listing of the given folder from the local listing index.
+    ///
+    /// The result may be outdated, it is only meant to show something until the live listing has arrived.
+    /// Returns false, if the folder isn't in the index or the index is disabled.
+    bool GetIndexedListing(const QString& containerName, const QString& prefixPath, std::vector<StorageBlobInfo>& directories, std::vector<StorageBlobInfo>& files) const;
+
     /// Returns the BlobContainerClient for the storage container with the given name.
     BlobContainerClient GetStorageContainerFromName(const QString& containerName) const;
 
@@ -132,23 +209,50 @@ protected:
 
     void ConnectToAzureStorageThread(const QString& endpointUrl, const std::shared_ptr<StorageSharedKeyCredential>& credentials);
 
-    StorageConnectionStatus m_connectionStatus = StorageConnectionStatus::NotAuthenticated;
+    bool ListBlobPages(const BlobContainerClient& container, const QString& containerName, const QString& prefixPath, const QString& continuationToken, bool useCache, const std::shared_ptr<ListingIndex>& index, const Azure::Core::Context& context, const ListBlobPageCallback& callback) const;
+    static bool ListFlatBlobPages(const BlobContainerClient& container, const QString& containerName, const QString& prefixPath, const Azure::Core::Context& context, const ListBlobPageCallback& callback);
+    static void DeleteBlobBatch(const BlobContainerClient& container, const QString& containerName, BlobJob& job, const std::vector<BlobItem>& blobs);
+    static void CopyBlob(const BlobContainerClient& srcContainer, const BlobContainerClient& dstContainer, const StorageSharedKeyCredential& credentials, const QString& srcContainerName, const BlobItem& blob, const QString& dstPath, bool move, BlobJob& job);
+
+    /// Keeps track of the job, so that it can be cancelled when the account gets disconnected.
+    void AddBlobJob(const std::shared_ptr<BlobJob>& job);
+
+    /// Opens the listing index of the container, if necessary. Must only be called on the main thread.
+    std::shared_ptr<ListingIndex> GetListingIndex(const QString& containerName) const;
+
+    /// Returns the listing index of the container, if it is already open. Can be called from any thread.
+    std::shared_ptr<ListingIndex> FindListingIndex(const QString& containerName) const;
 
-    struct BlobCache
-    {
-        std::vector<StorageBlobInfo> m_directories;
-        std::vector<StorageBlobInfo> m_files;
-    };
+    void CloseListingIndices();
+
+    StorageConnectionStatus m_connectionStatus = StorageConnectionStatus::NotAuthenticated;
 
     QString m_accountName;
     QString m_accountKey;
     QString m_endpointUrl;
 
     std::unique_ptr<FileUploader> m_fileUploader = nullptr;
-    mutable std::map<QString, BlobCache> m_cachedBlobs;
+    std::unique_ptr<FileDownloader> m_fileDownloader = nullptr;
+    mutable ListingCache m_listingCache;
+
+    bool m_useListingIndex = true;
+    mutable std::mutex m_listingIndicesMutex;
+    mutable std::map<QString, std::shared_ptr<ListingIndex>> m_listingIndices;
 
     std::shared_ptr<StorageSharedKeyCredential> m_azStorageCredentials;
+
+    // cancelled when the account gets disconnected, so that running listings don't wait for their next page anymore
+    Azure::Core::Context m_listingContext;
     std::unique_ptr<BlobServiceClient> m_azStorageServiceClient;
+
+    std::mutex m_blobJobsMutex;
+    std::vector<std::weak_ptr<BlobJob>> m_blobJobs;
+
+    // runs the delete batches and copies of blob jobs, the listings queue their tasks here, so the listing workers have to stop first
+    std::unique_ptr<WorkerPool> m_blobJobWorkers;
+
+    // runs the background listings, declared last, so that running listings are finished before anything else is destroyed
+    std::unique_ptr<WorkerPool> m_listingWorkers;
 };
 
 /// Mock implementation of StorageAccount to run ARRT UI without storage account credentials.
@@ -1,9 +1,83 @@
+#include <QApplication>
+#include <QDateTime>
+#include <QFont>
 #include <QIcon>
+#include <QLocale>
+#include <QPointer>
 #include <QProcessEnvironment>
+#include <QSet>
 #include <Storage/StorageAccount.h>
 #include <Storage/UI/StorageBrowserModel.h>
 #include <QFileInfo>
 
+// the row index of every child has to match its position, otherwise the indices of the grandchildren would point to the wrong parent row
+static void UpdateRowIndices(StorageEntry* entry, size_t first)
+{
+    for (size_t i = first; i < entry->m_children.size(); ++i)
+    {
+        entry->m_children[i]->m_rowIndex = (int)i;
+    }
+}
+
+/// The entries that a background listing found. They are created on the worker thread and moved into the model on the main thread.
+struct StorageBrowserModel::ListingResult
+{
+    std::vector<std::unique_ptr<StorageEntry>> m_entries;
+    QString m_continuationToken;
+    bool m_success = false;
+};
+
+// converts listed blobs into entries, skipping those that don't pass the filter
+static void AddEntries(StorageEntry::Type showTypes, const QString& parentPathFilter, const QString& entryPath, const std::vector<StorageBlobInfo>& directories, const std::vector<StorageBlobInfo>& files, std::vector<std::unique_ptr<StorageEntry>>& output)
+{
+    for (const StorageBlobInfo& dir : directories)
+    {
+        auto e = std::make_unique<StorageEntry>();
+        e->m_name = dir.m_path.mid(entryPath.length()).chopped(1); // remove the prefix path and the trailing slash
+        e->m_fullPath = dir.m_path;
+        e->m_Type = StorageEntry::Type::Folder;
+
+        if (!parentPathFilter.isEmpty() && (!parentPathFilter.startsWith(e->m_fullPath)))
+        {
+            continue;
+        }
+
+        output.push_back(std::move(e));
+    }
+
+    for (const StorageBlobInfo& file : files)
+    {
+        auto e = std::make_unique<StorageEntry>();
+        e->m_name = file.m_path.mid(entryPath.length()); // remove the prefix path
+        e->m_fullPath = file.m_path;
+        e->m_size = file.m_size;
+        e->m_lastModified = file.m_lastModified;
+        e->m_etag = file.m_etag;
+        e->m_contentHash = file.m_contentHash;
+
+        if (StorageBrowserModel::IsSrcAsset(e->m_name))
+        {
+            e->m_Type = StorageEntry::Type::SrcAsset;
+        }
+        else if (StorageBrowserModel::IsArrAsset(e->m_name))
+        {
+            e->m_Type = StorageEntry::Type::ArrAsset;
+        }
+
+        if (showTypes != e->m_Type && showTypes != StorageEntry::Type::Other)
+        {
+            continue;
+        }
+
+        if (!parentPathFilter.isEmpty() && (!parentPathFilter.startsWith(e->m_fullPath)))
+        {
+            continue;
+        }
+
+        output.push_back(std::move(e));
+    }
+}
+
 void StorageBrowserModel::SetFilter(StorageEntry::Type showTypes, const QString& parentPathFilter)
 {
     m_showTypes = showTypes;
@@ -36,10 +110,16 @@ void StorageBrowserModel::RefreshModel(bool fullReset)
         m_rootEntry.m_name = m_containerName;
         m_rootEntry.m_retrievedChildren = true;
         m_rootEntry.m_Type = StorageEntry::Type::Folder;
-
-        FillChildEntries(&m_rootEntry, "", m_rootEntry.m_children);
+        m_rootEntry.m_continuationToken.clear();
+        m_rootEntry.m_pendingListing = 0;
 
         endResetModel();
+
+        if (m_storageAccount != nullptr && !m_containerName.isEmpty() && !ShowIndexedListing(&m_rootEntry))
+        {
+            AddPlaceholder(&m_rootEntry);
+            StartListing(&m_rootEntry, QString(), 1, false);
+        }
     }
     else
     {
@@ -65,17 +145,7 @@ QModelIndex StorageBrowserModel::index(int row, int column, const QModelIndex& p
         if (row >= parentPtr->m_children.size())
             return {};
 
-        entryPtr = &parentPtr->m_children[row];
-    }
-
-    if (!entryPtr->m_retrievedChildren)
-    {
-        entryPtr->m_retrievedChildren = true;
-
-        if (entryPtr->m_fullPath.endsWith("/"))
-        {
-            FillChildEntries(entryPtr, entryPtr->m_fullPath, entryPtr->m_children);
-        }
+        entryPtr = parentPtr->m_children[row].get();
     }
 
     return createIndex(row, column, entryPtr);
@@ -91,7 +161,8 @@ QModelIndex StorageBrowserModel::parent(const QModelIndex& child) const
     if (entry->m_parent == nullptr)
         return {};
 
-    return createIndex(entry->m_parent->m_rowIndex, child.column(), entry->m_parent);
+    // only items in the first column have children
+    return createIndex(entry->m_parent->m_rowIndex, 0, entry->m_parent);
 }
 
 int StorageBrowserModel::rowCount(const QModelIndex& parent /*= QModelIndex()*/) const
@@ -112,7 +183,7 @@ int StorageBrowserModel::rowCount(const QModelIndex& parent /*= QModelIndex()*/)
 
 int StorageBrowserModel::columnCount(const QModelIndex& /*= QModelIndex()*/) const
 {
-    return 1;
+    return (int)Column::Count;
 }
 
 QVariant StorageBrowserModel::data(const QModelIndex& index, int role /*= Qt::DisplayRole*/) const
@@ -124,7 +195,45 @@ QVariant StorageBrowserModel::data(const QModelIndex& index, int role /*= Qt::Di
 
     if (role == Qt::DisplayRole)
     {
-        return entry->m_name;
+        if (entry->m_isPlaceholder || entry->m_Type == StorageEntry::Type::Folder)
+        {
+            return (index.column() == (int)Column::Name) ? entry->m_name : QVariant();
+        }
+
+        switch ((Column)index.column())
+        {
+            case Column::Name:
+                return entry->m_name;
+
+            case Column::Size:
+                return QLocale().formattedDataSize(entry->m_size);
+
+            case Column::LastModified:
+                return QLocale().toString(QDateTime::fromSecsSinceEpoch(entry->m_lastModified), QLocale::ShortFormat);
+
+            case Column::ContentHash:
+                return QString(entry->m_contentHash.toHex());
+
+            default:
+                return {};
+        }
+    }
+
+    if (role == Qt::TextAlignmentRole && index.column() == (int)Column::Size)
+    {
+        return static_cast<int>(Qt::AlignRight | Qt::AlignVCenter);
+    }
+
+    if (role == Qt::ToolTipRole && !entry->m_etag.isEmpty())
+    {
+        return QString("%1\nETag: %2").arg(entry->m_fullPath).arg(entry->m_etag);
+    }
+
+    if (role == Qt::FontRole && entry->m_isPlaceholder)
+    {
+        QFont font;
+        font.setItalic(true);
+        return font;
     }
 
     if (role == Qt::UserRole)
@@ -132,7 +241,7 @@ QVariant StorageBrowserModel::data(const QModelIndex& index, int role /*= Qt::Di
         return entry->m_fullPath;
     }
 
-    if (role == Qt::DecorationRole)
+    if (role == Qt::DecorationRole && index.column() == (int)Column::Name)
     {
         switch (entry->m_Type)
         {
@@ -153,115 +262,396 @@ QVariant StorageBrowserModel::data(const QModelIndex& index, int role /*= Qt::Di
     return {};
 }
 
-void StorageBrowserModel::FillChildEntries(StorageEntry* entry, const QString& entryPath, std::vector<StorageEntry>& output) const
+QVariant StorageBrowserModel::headerData(int section, Qt::Orientation orientation, int role /*= Qt::DisplayRole*/) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return {};
+
+    switch ((Column)section)
+    {
+        case Column::Name:
+            return QString("Name");
+        case Column::Size:
+            return QString("Size");
+        case Column::LastModified:
+            return QString("Last Modified");
+        case Column::ContentHash:
+            return QString("Content MD5");
+        default:
+            return {};
+    }
+}
+
+Qt::ItemFlags StorageBrowserModel::flags(const QModelIndex& index) const
+{
+    if (index.isValid() && ((const StorageEntry*)index.internalPointer())->m_isPlaceholder)
+    {
+        // the placeholder can't be selected
+        return Qt::ItemIsEnabled | Qt::ItemNeverHasChildren;
+    }
+
+    return QAbstractItemModel::flags(index);
+}
+
+bool StorageBrowserModel::hasChildren(const QModelIndex& parent /*= QModelIndex()*/) const
+{
+    if (!parent.isValid())
+        return rowCount(parent) > 0;
+
+    const StorageEntry* entry = (const StorageEntry*)parent.internalPointer();
+
+    // folders that haven't been listed yet, are assumed to have children, so that they can be expanded
+    if (!entry->m_retrievedChildren)
+        return entry->m_Type == StorageEntry::Type::Folder;
+
+    return !entry->m_children.empty();
+}
+
+bool StorageBrowserModel::canFetchMore(const QModelIndex& parent) const
+{
+    if (!parent.isValid())
+        return false;
+
+    const StorageEntry* entry = (const StorageEntry*)parent.internalPointer();
+
+    if (entry->m_Type != StorageEntry::Type::Folder || entry->m_pendingListing != 0)
+        return false;
+
+    return !entry->m_retrievedChildren || !entry->m_continuationToken.isEmpty();
+}
+
+void StorageBrowserModel::fetchMore(const QModelIndex& parent)
 {
-    if (m_storageAccount == nullptr)
+    if (m_storageAccount == nullptr || !canFetchMore(parent))
         return;
 
-    if (m_containerName.isEmpty())
+    StorageEntry* entry = (StorageEntry*)parent.internalPointer();
+
+    if (!entry->m_retrievedChildren && ShowIndexedListing(entry))
         return;
 
-    std::vector<StorageBlobInfo> directories, files;
-    m_storageAccount->ListBlobDirectory(m_containerName, entryPath, directories, files);
+    entry->m_retrievedChildren = true;
 
-    output.reserve(directories.size() + files.size());
-    int rowIdx = 0;
+    AddPlaceholder(entry);
+    StartListing(entry, entry->m_continuationToken, 1, false);
+}
 
-    for (const StorageBlobInfo& dir : directories)
+void StorageBrowserModel::CancelListing(const QModelIndex& index)
+{
+    if (!index.isValid())
+        return;
+
+    StorageEntry* entry = (StorageEntry*)index.internalPointer();
+
+    if (entry->m_pendingListing == 0)
+        return;
+
+    entry->m_pendingListing = 0;
+    RemovePlaceholder(entry);
+
+    // when the folder gets expanded again, the listing starts over
+    if (entry->m_children.empty())
     {
-        StorageEntry e;
-        e.m_parent = entry;
-        e.m_rowIndex = rowIdx++;
-        e.m_name = dir.m_path.mid(entryPath.length()).chopped(1); // remove the prefix path and the trailing slash
-        e.m_fullPath = dir.m_path;
-        e.m_Type = StorageEntry::Type::Folder;
-
-        if (!m_parentPathFilter.isEmpty() && (!m_parentPathFilter.startsWith(e.m_fullPath)))
+        entry->m_retrievedChildren = false;
+    }
+}
+
+void StorageBrowserModel::StartListing(StorageEntry* entry, const QString& continuationToken, size_t minEntries, bool refresh)
+{
+    const uint64_t listingId = m_nextListingId++;
+    entry->m_pendingListing = listingId;
+
+    const QString entryPath = entry->m_fullPath;
+    auto result = std::make_shared<ListingResult>();
+
+    // the listing runs on a worker thread, so it only works with copies of the model state
+    auto pageCallback = [result, minEntries, showTypes = m_showTypes, parentPathFilter = m_parentPathFilter, entryPath](const std::vector<StorageBlobInfo>& directories, const std::vector<StorageBlobInfo>& files, const QString& nextToken)
+    {
+        AddEntries(showTypes, parentPathFilter, entryPath, directories, files, result->m_entries);
+        result->m_continuationToken = nextToken;
+
+        // pages that are filtered out entirely are skipped, otherwise the view would have nothing to show and wouldn't ask for more
+        return result->m_entries.size() < minEntries;
+    };
+
+    // the model may be gone by the time the listing finishes, e.g. when a browse dialog was closed
+    auto finishedCallback = [model = QPointer<StorageBrowserModel>(this), result, entryPath, listingId, refresh](bool success)
+    {
+        result->m_success = success;
+
+        QMetaObject::invokeMethod(QApplication::instance(), [model, result, entryPath, listingId, refresh]()
+                                  {
+                                      if (model)
+                                      {
+                                          model->OnListingFinished(entryPath, listingId, *result, refresh);
+                                      } });
+    };
+
+    // a refresh is supposed to find changes, so it can't use cached listings
+    m_storageAccount->ListBlobDirectoryPagedAsync(m_containerName, entryPath, continuationToken, !refresh, std::move(pageCallback), std::move(finishedCallback));
+}
+
+void StorageBrowserModel::OnListingFinished(const QString& entryPath, uint64_t listingId, ListingResult& result, bool refresh)
+{
+    StorageEntry* entry = FindEntry(entryPath);
+
+    // the folder was collapsed, listed again or removed in the meantime
+    if (entry == nullptr || entry->m_pendingListing != listingId)
+        return;
+
+    entry->m_pendingListing = 0;
+
+    if (!result.m_success)
+    {
+        RemovePlaceholder(entry);
+
+        if (entry->m_children.empty())
         {
-            continue;
+            entry->m_retrievedChildren = false;
         }
 
-        output.push_back(e);
+        return;
     }
 
-    for (const StorageBlobInfo& file : files)
+    for (auto& child : result.m_entries)
+    {
+        child->m_parent = entry;
+    }
+
+    const QModelIndex idx = createIndex(entry->m_rowIndex, 0, entry);
+
+    if (!refresh)
     {
-        StorageEntry e;
-        e.m_parent = entry;
-        e.m_rowIndex = rowIdx++;
-        e.m_name = file.m_path.mid(entryPath.length()); // remove the prefix path
-        e.m_fullPath = file.m_path;
+        RemovePlaceholder(entry);
 
-        if (IsSrcAsset(e.m_name))
+        if (!result.m_entries.empty())
         {
-            e.m_Type = StorageEntry::Type::SrcAsset;
+            const int first = (int)entry->m_children.size();
+
+            beginInsertRows(idx, first, first + (int)result.m_entries.size() - 1);
+
+            for (auto& child : result.m_entries)
+            {
+                child->m_rowIndex = (int)entry->m_children.size();
+                entry->m_children.push_back(std::move(child));
+            }
+
+            endInsertRows();
         }
-        else if (IsArrAsset(e.m_name))
+
+        entry->m_continuationToken = result.m_continuationToken;
+        return;
+    }
+
+    entry->m_hasChanged = false;
+    entry->m_continuationToken = result.m_continuationToken;
+
+    MergeChildren(entry, result.m_entries);
+}
+
+void StorageBrowserModel::MergeChildren(StorageEntry* entry, std::vector<std::unique_ptr<StorageEntry>>& children)
+{
+    const QModelIndex idx = createIndex(entry->m_rowIndex, 0, entry);
+    std::vector<std::unique_ptr<StorageEntry>>& current = entry->m_children;
+
+    QSet<QString> newPaths;
+    newPaths.reserve((int)children.size());
+
+    for (const auto& child : children)
+    {
+        newPaths.insert(child->m_fullPath);
+    }
+
+    auto isGone = [&newPaths](const std::unique_ptr<StorageEntry>& child)
+    {
+        return child->m_isPlaceholder || !newPaths.contains(child->m_fullPath);
+    };
+
+    // remove the entries that don't exist anymore, back to front, so that the row numbers of the remaining ranges stay valid
+    for (int last = (int)current.size() - 1; last >= 0; --last)
+    {
+        if (!isGone(current[last]))
+            continue;
+
+        int first = last;
+        while (first > 0 && isGone(current[first - 1]))
         {
-            e.m_Type = StorageEntry::Type::ArrAsset;
+            --first;
         }
 
-        if (m_showTypes != e.m_Type && m_showTypes != StorageEntry::Type::Other)
+        beginRemoveRows(idx, first, last);
+        current.erase(current.begin() + first, current.begin() + last + 1);
+        UpdateRowIndices(entry, first);
+        endRemoveRows();
+
+        entry->m_hasChanged = true;
+        last = first;
+    }
+
+    // both lists are in listing order, so walking them side by side finds the new entries and the ones that were modified
+    size_t row = 0;
+    size_t next = 0;
+
+    while (next < children.size())
+    {
+        if (row < current.size() && current[row]->m_fullPath == children[next]->m_fullPath)
         {
+            StorageEntry* existing = current[row].get();
+
+            if (existing->IsDifferent(*children[next]))
+            {
+                existing->m_size = children[next]->m_size;
+                existing->m_lastModified = children[next]->m_lastModified;
+                existing->m_etag = children[next]->m_etag;
+                existing->m_contentHash = children[next]->m_contentHash;
+
+                Q_EMIT dataChanged(createIndex((int)row, 0, existing), createIndex((int)row, (int)Column::Count - 1, existing));
+                entry->m_hasChanged = true;
+            }
+
+            // the existing entry keeps its children, they are only updated where they changed
+            RefreshEntry(existing);
+
+            ++row;
+            ++next;
             continue;
         }
 
-        if (!m_parentPathFilter.isEmpty() && (!m_parentPathFilter.startsWith(e.m_fullPath)))
+        // all new entries up to the next existing one are inserted as one range
+        size_t end = next + 1;
+        while (end < children.size() && (row >= current.size() || current[row]->m_fullPath != children[end]->m_fullPath))
         {
-            continue;
+            ++end;
         }
 
-        output.push_back(e);
+        beginInsertRows(idx, (int)row, (int)(row + end - next) - 1);
+        current.insert(current.begin() + row, std::make_move_iterator(children.begin() + next), std::make_move_iterator(children.begin() + end));
+        UpdateRowIndices(entry, row);
+        endInsertRows();
+
+        entry->m_hasChanged = true;
+        row += end - next;
+        next = end;
+    }
+
+    // only happens, if the order of the listing changed, in that case the remaining entries were inserted again above
+    if (row < current.size())
+    {
+        beginRemoveRows(idx, (int)row, (int)current.size() - 1);
+        current.erase(current.begin() + row, current.end());
+        endRemoveRows();
+
+        entry->m_hasChanged = true;
     }
 }
 
-void StorageBrowserModel::RefreshEntry(StorageEntry* entry)
+void StorageBrowserModel::AddPlaceholder(StorageEntry* entry)
 {
-    if (!entry->m_retrievedChildren || (!entry->m_fullPath.isEmpty() && !entry->m_fullPath.endsWith("/")))
+    if (!entry->m_children.empty() && entry->m_children.back()->m_isPlaceholder)
         return;
 
-    std::vector<StorageEntry> children;
-    FillChildEntries(entry, entry->m_fullPath, children);
+    auto placeholder = std::make_unique<StorageEntry>();
+    placeholder->m_parent = entry;
+    placeholder->m_name = "Loading...";
+    placeholder->m_isPlaceholder = true;
+    placeholder->m_retrievedChildren = true;
+    placeholder->m_rowIndex = (int)entry->m_children.size();
 
-    entry->m_hasChanged = entry->m_children.size() != children.size();
+    beginInsertRows(createIndex(entry->m_rowIndex, 0, entry), placeholder->m_rowIndex, placeholder->m_rowIndex);
+    entry->m_children.push_back(std::move(placeholder));
+    endInsertRows();
+}
+
+void StorageBrowserModel::RemovePlaceholder(StorageEntry* entry)
+{
+    if (entry->m_children.empty() || !entry->m_children.back()->m_isPlaceholder)
+        return;
 
-    if (!entry->m_hasChanged)
+    const int row = (int)entry->m_children.size() - 1;
+
+    beginRemoveRows(createIndex(entry->m_rowIndex, 0, entry), row, row);
+    entry->m_children.pop_back();
+    endRemoveRows();
+}
+
+StorageEntry* StorageBrowserModel::FindEntry(const QString& fullPath)
+{
+    StorageEntry* entry = &m_rootEntry;
+
+    while (entry->m_fullPath != fullPath)
     {
-        for (size_t i = 0; i < children.size(); ++i)
+        StorageEntry* next = nullptr;
+
+        for (const auto& child : entry->m_children)
         {
-            if (entry->m_children[i].IsDifferent(children[i]))
+            // folder paths end with a slash, so a matching prefix is either the folder itself or one of its parents
+            if (child->m_Type == StorageEntry::Type::Folder && fullPath.startsWith(child->m_fullPath))
             {
-                entry->m_hasChanged = true;
+                next = child.get();
                 break;
             }
         }
+
+        if (next == nullptr)
+            return nullptr;
+
+        entry = next;
     }
 
-    if (entry->m_hasChanged)
+    return entry;
+}
+
+bool StorageBrowserModel::ShowIndexedListing(StorageEntry* entry)
+{
+    std::vector<StorageBlobInfo> directories;
+    std::vector<StorageBlobInfo> files;
+
+    if (!m_storageAccount->GetIndexedListing(m_containerName, entry->m_fullPath, directories, files))
+        return false;
+
+    std::vector<std::unique_ptr<StorageEntry>> children;
+    AddEntries(m_showTypes, m_parentPathFilter, entry->m_fullPath, directories, files, children);
+
+    entry->m_retrievedChildren = true;
+
+    if (!children.empty())
     {
-        const QModelIndex idx = createIndex(entry->m_rowIndex, 0, entry);
+        const int first = (int)entry->m_children.size();
 
-        if (!entry->m_children.empty())
-        {
-            beginRemoveRows(idx, 0, (int)entry->m_children.size() - 1);
-            entry->m_children.clear();
-            endRemoveRows();
-        }
+        beginInsertRows(createIndex(entry->m_rowIndex, 0, entry), first, first + (int)children.size() - 1);
 
-        if (!children.empty())
+        for (auto& child : children)
         {
-            beginInsertRows(idx, 0, (int)children.size() - 1);
-            entry->m_children = children;
-            endInsertRows();
+            child->m_parent = entry;
+            child->m_rowIndex = (int)entry->m_children.size();
+            entry->m_children.push_back(std::move(child));
         }
+
+        endInsertRows();
     }
-    else
+
+    // the index may be outdated, so the folder gets listed again right away and only the differences are applied
+    RefreshEntry(entry);
+    return true;
+}
+
+void StorageBrowserModel::RefreshEntry(StorageEntry* entry)
+{
+    if (m_storageAccount == nullptr || !entry->m_retrievedChildren || entry->m_Type != StorageEntry::Type::Folder)
+        return;
+
+    size_t shownEntries = 0;
+    for (const auto& child : entry->m_children)
     {
-        for (size_t c = 0; c < entry->m_children.size(); ++c)
+        if (!child->m_isPlaceholder)
         {
-            RefreshEntry(&entry->m_children[c]);
+            ++shownEntries;
         }
     }
+
+    // retrieve at least as many children as are currently shown, so that the comparison is meaningful
+    // a listing that is still running for this folder is superseded by this one
+    StartListing(entry, QString(), std::max<size_t>(1, shownEntries), true);
 }
 
 bool StorageBrowserModel::IsArrAsset(const QString& file)
@@ -293,10 +683,9 @@ bool StorageBrowserModel::IsSingleFileAsset(const QString& file)
 
 bool StorageEntry::IsDifferent(const StorageEntry& rhs) const
 {
-    if (m_name != rhs.m_name)
+    if (m_name != rhs.m_name || m_Type != rhs.m_Type)
         return true;
 
-    // more criteria?
-
-    return false;
+    // the ETag changes with every modification, the other properties are compared in case the listing didn't provide one
+    return m_etag != rhs.m_etag || m_size != rhs.m_size || m_lastModified != rhs.m_lastModified || m_contentHash != rhs.m_contentHash;
 }
@@ -2,6 +2,7 @@
 
 #include <QAbstractItemModel>
 #include <Storage/IncludeAzureStorage.h>
+#include <memory>
 #include <vector>
 #include <Conversion/Conversion.h>
 
@@ -19,13 +20,24 @@ struct StorageEntry
 
     QString m_fullPath;
     QString m_name;
+    int64_t m_size = 0;         ///< File size in bytes, zero for folders.
+    int64_t m_lastModified = 0; ///< Seconds since the epoch, zero for folders.
+    QString m_etag;
+    QByteArray m_contentHash; ///< The MD5 hash of the file content, empty if unknown.
     bool m_retrievedChildren = false;
     bool m_hasChanged = false;
+    bool m_isPlaceholder = false; ///< The "Loading..." entry that is shown while the children of a folder are being retrieved.
+    uint64_t m_pendingListing = 0; ///< Identifies the listing that currently runs for the children of this folder, zero if none.
     int m_rowIndex = -1;
     StorageEntry* m_parent = nullptr;
-    std::vector<StorageEntry> m_children;
     Type m_Type = Type::Other;
 
+    /// The model indices point to the entries, so they must not move in memory when more children are added.
+    std::vector<std::unique_ptr<StorageEntry>> m_children;
+
+    /// If not empty, the folder has more children than were retrieved so far. Used to retrieve the next page of the listing.
+    QString m_continuationToken;
+
     bool IsDifferent(const StorageEntry& rhs) const;
 };
 
@@ -33,11 +45,23 @@ struct StorageEntry
 ///
 /// The model queries the Azure Storage only as much as needed to show the file structure.
 /// Collapsed folders are not queried, only when the user expands them.
+/// Large folders are retrieved page by page, the next page is only requested once the view scrolls to the end (see fetchMore()).
+/// All listings run in the background, while they are running, the folder shows a placeholder entry.
 class StorageBrowserModel : public QAbstractItemModel
 {
     Q_OBJECT
 
 public:
+    /// The columns of the model. All of them are filled from the folder listing, so they don't cost additional requests.
+    enum class Column
+    {
+        Name,
+        Size,
+        LastModified,
+        ContentHash,
+        Count
+    };
+
     void SetFilter(StorageEntry::Type showTypes, const QString& parentPathFilter);
     bool SetAccountAndContainer(StorageAccount* account, const QString& containerName);
 
@@ -51,6 +75,14 @@ public:
     virtual int rowCount(const QModelIndex& parent = QModelIndex()) const override;
     virtual int columnCount(const QModelIndex& parent = QModelIndex()) const override;
     virtual QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    virtual Qt::ItemFlags flags(const QModelIndex& index) const override;
+    virtual bool hasChildren(const QModelIndex& parent = QModelIndex()) const override;
+    virtual bool canFetchMore(const QModelIndex& parent) const override;
+    virtual void fetchMore(const QModelIndex& parent) override;
+
+    /// Drops the results of a listing that is still running for the given folder, e.g. because the folder was collapsed.
+    void CancelListing(const QModelIndex& index);
 
     static bool IsArrAsset(const QString& file);
     static bool IsSrcAsset(const QString& file);
@@ -58,13 +90,33 @@ public:
 
 
 private:
-    void FillChildEntries(StorageEntry* entry, const QString& entryPath, std::vector<StorageEntry>& output) const;
+    struct ListingResult;
+
+    /// Starts a background listing of the children of 'entry', beginning at 'continuationToken', until at least 'minEntries' entries were found.
+    ///
+    /// If 'refresh' is true, the result is merged into the existing children of the entry (see MergeChildren()), otherwise it is appended.
+    /// Only the most recent listing of an entry is applied, the results of earlier ones are dropped.
+    void StartListing(StorageEntry* entry, const QString& continuationToken, size_t minEntries, bool refresh);
+    void OnListingFinished(const QString& entryPath, uint64_t listingId, ListingResult& result, bool refresh);
+
+    /// Updates the children of 'entry' to match 'children', which is a new listing of the folder.
+    ///
+    /// Entries are matched by their full path. Only the rows that were added, removed or modified are touched,
+    /// all other entries (including their subtrees) stay as they are, so expanded folders and the selection are kept.
+    void MergeChildren(StorageEntry* entry, std::vector<std::unique_ptr<StorageEntry>>& children);
+    void AddPlaceholder(StorageEntry* entry);
+    void RemovePlaceholder(StorageEntry* entry);
+    StorageEntry* FindEntry(const QString& fullPath);
+
+    /// Shows the children of 'entry' that are stored in the listing index and revalidates them in the background. Returns false, if the index doesn't know the folder.
+    bool ShowIndexedListing(StorageEntry* entry);
     void RefreshEntry(StorageEntry* entry);
 
     StorageAccount* m_storageAccount = nullptr;
     QString m_containerName;
     StorageEntry::Type m_showTypes = StorageEntry::Type::Other;
     QString m_parentPathFilter;
+    uint64_t m_nextListingId = 1;
 
     mutable StorageEntry m_rootEntry;
 };
\ No newline at end of file
@@ -1,9 +1,15 @@
-#include <QDirIterator>
+#include <QApplication>
+#include <QDir>
 #include <QFileDialog>
+#include <QHeaderView>
 #include <QInputDialog>
+#include <QMenu>
 #include <QMessageBox>
+#include <QPointer>
+#include <QProgressDialog>
 #include <QShortcut>
 #include <Storage/StorageAccount.h>
+#include <Storage/UI/BrowseStorageDlg.h>
 #include <Storage/UI/StorageBrowserWidget.h>
 #include <Utils/Logging.h>
 
@@ -24,6 +30,12 @@ StorageBrowserWidget::StorageBrowserWidget(QWidget* parent /*= {}*/)
     QShortcut* shortcutUploadFolder = new QShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_U), FileTree);
     connect(shortcutUploadFolder, SIGNAL(activated()), this, SLOT(on_UploadFolderButton_clicked()));
 
+    QShortcut* shortcutRename = new QShortcut(QKeySequence(Qt::Key_F2), FileTree);
+    connect(shortcutRename, SIGNAL(activated()), this, SLOT(RenameSelectedItem()));
+
+    FileTree->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(FileTree, &QTreeView::customContextMenuRequested, this, &StorageBrowserWidget::ShowItemContextMenu);
+
     on_StorageContainer_currentIndexChanged(-1);
 }
 
@@ -55,6 +67,7 @@ void StorageBrowserWidget::SetStorageAccount(StorageAccount* account, StorageEnt
     AddFolderButton->setVisible(!parentOnly);
 
     m_storageAccount = account;
+    m_allowEdits = allowEdits;
     m_storageModel.SetFilter(showTypes, parentFilter);
 
     UpdateUI();
@@ -68,9 +81,18 @@ void StorageBrowserWidget::SetStorageAccount(StorageAccount* account, StorageEnt
     FileTree->setModel(&m_storageModel);
     FileTree->expandToDepth(0);
 
+    // the name takes all the space that the details leave
+    FileTree->header()->setSectionResizeMode((int)StorageBrowserModel::Column::Name, QHeaderView::Stretch);
+    FileTree->header()->setSectionResizeMode((int)StorageBrowserModel::Column::Size, QHeaderView::ResizeToContents);
+    FileTree->header()->setSectionResizeMode((int)StorageBrowserModel::Column::LastModified, QHeaderView::ResizeToContents);
+    FileTree->header()->setSectionResizeMode((int)StorageBrowserModel::Column::ContentHash, QHeaderView::Interactive);
+
     // these connections have to be set AFTER the tree model has been set for the first time
     connect(FileTree, &QTreeView::doubleClicked, this, &StorageBrowserWidget::ItemDoubleClicked);
     connect(FileTree->selectionModel(), &QItemSelectionModel::selectionChanged, this, &StorageBrowserWidget::ItemSelectionChanged);
+
+    // the results of listings for collapsed folders aren't needed anymore
+    connect(FileTree, &QTreeView::collapsed, &m_storageModel, &StorageBrowserModel::CancelListing);
 }
 
 void StorageBrowserWidget::on_StorageContainer_currentIndexChanged(int index)
@@ -239,6 +261,9 @@ void StorageBrowserWidget::on_DeleteItemButton_clicked()
         {
             return;
         }
+
+        DeleteFolder(m_selectedContainer, m_selectedItem);
+        return;
     }
     else
     {
@@ -259,6 +284,182 @@ void StorageBrowserWidget::on_DeleteItemButton_clicked()
     }
 }
 
+void StorageBrowserWidget::DeleteFolder(const QString& containerName, const QString& path)
+{
+    RunBlobJob("Deleting Folder", QString("Deleting %1/%2").arg(containerName).arg(path), "deleted", [this, containerName, path](BlobJob::ProgressCallback onProgress)
+               { return m_storageAccount->DeleteFolderAsync(containerName, path, std::move(onProgress)); });
+}
+
+void StorageBrowserWidget::RunBlobJob(const QString& title, const QString& description, const QString& doneVerb, const std::function<std::shared_ptr<BlobJob>(BlobJob::ProgressCallback)>& startJob)
+{
+    // large folders take a while, so the job runs in the background and the dialog only shows up, if it isn't done quickly
+    QProgressDialog* progressDlg = new QProgressDialog(description, "Cancel", 0, 0, this);
+    progressDlg->setWindowTitle(title);
+    progressDlg->setWindowModality(Qt::WindowModal);
+    progressDlg->setAutoClose(false);
+    progressDlg->setAutoReset(false);
+    progressDlg->setMinimumDuration(500);
+
+    auto onProgress = [widget = QPointer<StorageBrowserWidget>(this), dlg = QPointer<QProgressDialog>(progressDlg), title, description, doneVerb](const BlobJobProgress& progress)
+    {
+        QMetaObject::invokeMethod(QApplication::instance(), [widget, dlg, title, description, doneVerb, progress]()
+                                  {
+                                      if (dlg && !progress.m_finished)
+                                      {
+                                          // until the listing is done, the total is unknown and the dialog only shows that something is happening
+                                          dlg->setMaximum(progress.m_listingFinished ? (int)progress.m_foundBlobs : 0);
+                                          dlg->setValue((int)(progress.m_completedBlobs + progress.m_failedBlobs));
+                                          QString label = QString("%1\n\n%2 of %3 files %4").arg(description).arg(progress.m_completedBlobs).arg(progress.m_foundBlobs).arg(doneVerb);
+
+                                          // downloads also report the data of files that are still in progress, so that large files don't look stuck
+                                          if (progress.m_transferredBytes > 0)
+                                          {
+                                              label += QString(" (%1 of %2 MB)").arg(progress.m_transferredBytes / (1024.0 * 1024.0), 0, 'f', 1).arg(progress.m_foundBytes / (1024.0 * 1024.0), 0, 'f', 1);
+                                          }
+
+                                          dlg->setLabelText(label);
+                                          return;
+                                      }
+
+                                      if (!progress.m_finished)
+                                          return;
+
+                                      if (dlg)
+                                      {
+                                          dlg->deleteLater();
+                                      }
+
+                                      if (!widget)
+                                          return;
+
+                                      widget->m_storageModel.RefreshModel(false);
+
+                                      if (progress.m_failedBlobs > 0)
+                                      {
+                                          QMessageBox::warning(widget, title + " Failed", QString("%1\n\n%2 of %3 files could not be %4.\n\n%5").arg(description).arg(progress.m_failedBlobs).arg(progress.m_foundBlobs).arg(doneVerb).arg(progress.m_failures.join("\n")), QMessageBox::StandardButton::Ok);
+                                      }
+                                      else if (progress.m_listingFailed)
+                                      {
+                                          QMessageBox::warning(widget, title + " Failed", QString("%1\n\nThe items could not be listed completely, some files may not have been %2.").arg(description).arg(doneVerb), QMessageBox::StandardButton::Ok);
+                                      } },
+                                  // always queued, the job may report that it is finished before it was even returned
+                                  Qt::QueuedConnection);
+    };
+
+    std::shared_ptr<BlobJob> job = startJob(std::move(onProgress));
+
+    connect(progressDlg, &QProgressDialog::canceled, progressDlg, [job]()
+            { job->Cancel(); });
+}
+
+void StorageBrowserWidget::ShowItemContextMenu(const QPoint& pos)
+{
+    if (!m_allowEdits || m_selectedItem.isEmpty())
+        return;
+
+    QMenu menu(this);
+    menu.addAction("Copy To...", [this]()
+                   { CopyOrMoveSelectedItem(false); });
+    menu.addAction("Move To...", [this]()
+                   { CopyOrMoveSelectedItem(true); });
+    menu.addAction("Rename...", [this]()
+                   { RenameSelectedItem(); });
+    menu.addSeparator();
+    menu.addAction("Download To...", [this]()
+                   { DownloadSelectedItem(); });
+    menu.exec(FileTree->viewport()->mapToGlobal(pos));
+}
+
+void StorageBrowserWidget::CopyOrMoveSelectedItem(bool move)
+{
+    if (!m_allowEdits || m_selectedItem.isEmpty())
+        return;
+
+    const QString srcContainer = m_selectedContainer;
+    const QString srcPath = m_selectedItem;
+    const bool isFolder = srcPath.endsWith("/");
+
+    BrowseStorageDlg dlg(m_storageAccount, StorageEntry::Type::Folder, srcContainer, QString(), this, move ? "Move To..." : "Copy To...");
+
+    if (dlg.exec() != QDialog::Accepted)
+        return;
+
+    // the item keeps its name and goes into the selected folder
+    QString name = isFolder ? srcPath.chopped(1) : srcPath;
+    name = name.mid(name.lastIndexOf("/") + 1);
+
+    const QString dstContainer = dlg.GetSelectedContainer();
+    const QString dstPath = dlg.GetSelectedItem() + name + (isFolder ? "/" : "");
+
+    if (dstContainer == srcContainer && (dstPath == srcPath || (isFolder && dstPath.startsWith(srcPath))))
+    {
+        QMessageBox::warning(this, move ? "Moving Failed" : "Copying Failed", QString("'%1/%2' can't be %3 into itself.").arg(srcContainer).arg(srcPath).arg(move ? "moved" : "copied"), QMessageBox::StandardButton::Ok);
+        return;
+    }
+
+    if (QMessageBox::question(this, move ? "Confirm Move" : "Confirm Copy", QString("Do you want to %1\n\n%2/%3\n\nto\n\n%4/%5\n\nExisting files at the destination are overwritten.").arg(move ? "move" : "copy").arg(srcContainer).arg(srcPath).arg(dstContainer).arg(dstPath), QMessageBox::Yes | QMessageBox::No, QMessageBox::Yes) != QMessageBox::Yes)
+    {
+        return;
+    }
+
+    RunBlobJob(move ? "Moving" : "Copying", QString("%1 %2/%3 to %4/%5").arg(move ? "Moving" : "Copying").arg(srcContainer).arg(srcPath).arg(dstContainer).arg(dstPath), move ? "moved" : "copied", [this, srcContainer, srcPath, dstContainer, dstPath, move](BlobJob::ProgressCallback onProgress)
+               { return m_storageAccount->CopyItemAsync(srcContainer, srcPath, dstContainer, dstPath, move, std::move(onProgress)); });
+}
+
+void StorageBrowserWidget::RenameSelectedItem()
+{
+    if (!m_allowEdits || m_selectedItem.isEmpty())
+        return;
+
+    const QString srcPath = m_selectedItem;
+    const bool isFolder = srcPath.endsWith("/");
+
+    const QString itemPath = isFolder ? srcPath.chopped(1) : srcPath;
+    const QString parentPath = itemPath.left(itemPath.lastIndexOf("/") + 1);
+    const QString oldName = itemPath.mid(parentPath.length());
+
+    bool ok = false;
+    const QString newName = QInputDialog::getText(this, "Rename", "Choose a new name.", QLineEdit::Normal, oldName, &ok, {}, Qt::InputMethodHint::ImhUrlCharactersOnly);
+
+    if (!ok || newName.isEmpty() || newName == oldName)
+        return;
+
+    if (newName.contains("/"))
+    {
+        QMessageBox::warning(this, "Renaming Failed", "The name must not contain a slash. Use 'Move To...' to put the item into another folder.", QMessageBox::StandardButton::Ok);
+        return;
+    }
+
+    // a rename is a move within the same folder
+    const QString dstPath = parentPath + newName + (isFolder ? "/" : "");
+
+    RunBlobJob("Renaming", QString("Renaming %1/%2 to %3").arg(m_selectedContainer).arg(srcPath).arg(newName), "renamed", [this, container = m_selectedContainer, srcPath, dstPath](BlobJob::ProgressCallback onProgress)
+               { return m_storageAccount->CopyItemAsync(container, srcPath, container, dstPath, true, std::move(onProgress)); });
+}
+
+void StorageBrowserWidget::DownloadSelectedItem()
+{
+    if (m_selectedItem.isEmpty())
+        return;
+
+    FileDownloader* fileDownloader = m_storageAccount->GetFileDownloader();
+    if (fileDownloader == nullptr)
+        return;
+
+    QFileDialog fd(this);
+    fd.setFileMode(QFileDialog::Directory);
+    fd.setOption(QFileDialog::DontUseNativeDialog, false);
+    fd.setWindowTitle("Select folder to download to");
+
+    if (!fd.exec() || fd.selectedFiles().isEmpty())
+        return;
+
+    const QString localDirectory = fd.selectedFiles()[0];
+
+    RunBlobJob("Downloading", QString("Downloading %1/%2 to %3").arg(m_selectedContainer).arg(m_selectedItem).arg(QDir::toNativeSeparators(localDirectory)), "downloaded", [fileDownloader, container = m_selectedContainer, path = m_selectedItem, localDirectory](BlobJob::ProgressCallback onProgress)
+               { return fileDownloader->DownloadItemAsync(container, path, localDirectory, std::move(onProgress)); });
+}
+
 void StorageBrowserWidget::on_AddFolderButton_clicked()
 {
     const int lastSlash = m_selectedItem.lastIndexOf("/");
@@ -288,55 +489,38 @@ void StorageBrowserWidget::on_AddFolderButton_clicked()
     m_storageModel.RefreshModel(false);
 }
 
-static QStringList GetFullFileList(const QStringList& localPaths)
-{
-    QStringList fullFileList;
-    for (const auto& path : localPaths)
-    {
-        QDir dir(path);
-        if (dir.exists())
-        {
-            QDirIterator it(path, QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
-            while (it.hasNext())
-            {
-                it.next();
-                fullFileList.append(it.filePath());
-            }
-        }
-        else
-        {
-            if (QFileInfo::exists(path))
-            {
-                fullFileList.append(path);
-            }
-        }
-    }
-    return fullFileList;
-}
-
 void StorageBrowserWidget::UploadItems(const QStringList& files)
 {
     if (files.isEmpty())
         return;
 
+    FileUploader* fileUploader = m_storageAccount->GetFileUploader();
+    if (fileUploader == nullptr)
+        return;
+
     // the parent of the first file is the root directory
     QFileInfo fileInfo(files[0]);
     QDir rootDirectory = fileInfo.dir();
 
-    QStringList toUpload = GetFullFileList(files);
-
     const int lastSlash = m_selectedItem.lastIndexOf("/");
     QString dstFolder = m_selectedItem.left(lastSlash + 1);
 
-    if (QMessageBox::question(this, "Confirm file upload", QString("%1 files will be uploaded into\n%2/%3\n\nContinue?").arg(toUpload.count()).arg(GetSelectedContainer()).arg(dstFolder), QMessageBox::StandardButton::Yes | QMessageBox::StandardButton::No, QMessageBox::StandardButton::Yes) != QMessageBox::StandardButton::Yes)
+    // folders are scanned while the upload runs, so the number of files isn't known yet
+    QString message = QString("The selected %1 will be uploaded into\n%2/%3\n\n").arg(QFileInfo(files[0]).isDir() ? "folder" : "files").arg(GetSelectedContainer()).arg(dstFolder);
+
+    if (fileUploader->GetSkipUnchangedFiles())
     {
-        return;
+        message += "Files that are unchanged at the destination will be skipped.\n\n";
     }
 
-    if (auto file_uploader = m_storageAccount->GetFileUploader(); file_uploader != nullptr)
+    message += "Continue?";
+
+    if (QMessageBox::question(this, "Confirm file upload", message, QMessageBox::StandardButton::Yes | QMessageBox::StandardButton::No, QMessageBox::StandardButton::Yes) != QMessageBox::StandardButton::Yes)
     {
-        file_uploader->UploadFilesAsync(rootDirectory, toUpload, GetSelectedContainer(), dstFolder);
+        return;
     }
+
+    fileUploader->UploadPathsAsync(rootDirectory, files, GetSelectedContainer(), dstFolder);
 }
 
 void StorageBrowserWidget::on_UploadFileButton_clicked()
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ui_StorageBrowserWidget.h"
+#include <Storage/BlobJob.h>
 #include <Storage/UI/StorageBrowserModel.h>
 
 class StorageAccount;
@@ -40,11 +41,21 @@ private Q_SLOTS:
     void on_UploadFileButton_clicked();
     void on_UploadFolderButton_clicked();
     void on_RefreshButton_clicked();
+    void ShowItemContextMenu(const QPoint& pos);
+    void RenameSelectedItem();
 
 private:
     void UpdateUI();
     void EmitItemSelected(bool dblClick);
     void UploadItems(const QStringList& files);
+    void DeleteFolder(const QString& containerName, const QString& path);
+    void CopyOrMoveSelectedItem(bool move);
+    void DownloadSelectedItem();
+
+    /// Starts a job through 'startJob', shows its progress in a dialog that allows to cancel it, and reports failures once it is done.
+    ///
+    /// 'doneVerb' describes what happens to the files, e.g. "deleted", and is used in the progress and error messages.
+    void RunBlobJob(const QString& title, const QString& description, const QString& doneVerb, const std::function<std::shared_ptr<BlobJob>(BlobJob::ProgressCallback)>& startJob);
 
     QString m_selectedContainer;
     QString m_selectedItem;
@@ -52,4 +63,5 @@ private:
     StorageBrowserModel m_storageModel;
     std::vector<QString> m_StorageContainers;
     StorageEntry::Type m_showTypes = StorageEntry::Type::Other;
+    bool m_allowEdits = false;
 };
@@ -2,18 +2,33 @@
 #include <Storage/StorageAccount.h>
 #include <Utils/Logging.h>
 
-void ArrtAppWindow::FileUploadStatusCallback(int numFiles, float percentage)
+void ArrtAppWindow::FileUploadStatusCallback(const FileUploadProgress& progress)
 {
-    m_numFileUploads = numFiles;
-    m_fileUploadPercentage = percentage;
+    m_fileUploadProgress = progress;
     OnUpdateStatusBar();
 
-    if (numFiles == 0)
+    if (progress.m_remainingFiles == 0 && !progress.m_scanning)
     {
-        m_storageAccount->ClearCache();
+        // the uploaded files were already removed from the listing cache, so refreshing picks them up
         StorageBrowser->RefreshModel();
 
         ScreenReaderAlert("Upload", nullptr);
-        ScreenReaderAlert("Upload", "File upload finished");
+
+        if (progress.m_failedFiles > 0)
+        {
+            ScreenReaderAlert("Upload", QString("File upload finished, %1 files failed").arg(progress.m_failedFiles).toUtf8().data());
+        }
+        else if (progress.m_cancelledFiles > 0)
+        {
+            ScreenReaderAlert("Upload", "File upload cancelled");
+        }
+        else if (progress.m_skippedFiles > 0)
+        {
+            ScreenReaderAlert("Upload", QString("File upload finished, %1 unchanged files (%2 MB) skipped").arg(progress.m_skippedFiles).arg(progress.m_skippedBytes / (1024.0 * 1024.0), 0, 'f', 2).toUtf8().data());
+        }
+        else
+        {
+            ScreenReaderAlert("Upload", "File upload finished");
+        }
     }
 }
\ No newline at end of file
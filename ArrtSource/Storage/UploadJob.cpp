@@ -0,0 +1,88 @@
+#include <Storage/UploadJob.h>
+#include <Storage/WorkerPool.h>
+
+UploadJob::UploadJob(WorkerPool* workerPool)
+    : m_workerPool(workerPool)
+{
+}
+
+void UploadJob::Pause()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_cancelled)
+    {
+        m_paused = true;
+    }
+}
+
+void UploadJob::Resume()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_paused)
+        return;
+
+    m_paused = false;
+
+    if (m_workerPool == nullptr)
+        return;
+
+    for (HeldWork& held : m_heldWork)
+    {
+        m_workerPool->AddJob(held.m_priority, std::move(held.m_work));
+    }
+
+    m_heldWork.clear();
+}
+
+void UploadJob::Cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_cancelled)
+            return;
+
+        m_cancelled = true;
+        m_context.Cancel();
+    }
+
+    // the held back work has to run once more, to finish the files as cancelled
+    Resume();
+
+    // so do blocks that wait for a retry, other jobs' retries are only sent a bit earlier than planned because of this
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_workerPool != nullptr)
+    {
+        m_workerPool->RunDelayedJobsNow();
+    }
+}
+
+void UploadJob::Schedule(int64_t priority, std::function<void()> work)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_workerPool == nullptr)
+        return;
+
+    if (m_paused)
+    {
+        m_heldWork.push_back({priority, std::move(work)});
+        return;
+    }
+
+    m_workerPool->AddJob(priority, std::move(work));
+}
+
+void UploadJob::Detach()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_cancelled = true;
+    m_context.Cancel();
+
+    m_workerPool = nullptr;
+    m_heldWork.clear();
+}
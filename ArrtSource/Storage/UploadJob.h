@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Storage/IncludeAzureStorage.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class WorkerPool;
+
+/// A handle to all files that were passed to one call of FileUploader::UploadFilesAsync() or FileUploader::UploadPathsAsync().
+///
+/// Pausing lets the blocks that are currently being sent finish, but doesn't start any new ones until the job is resumed.
+/// Cancelling aborts the requests that are in flight and stops all files of the job that aren't finished yet.
+class UploadJob
+{
+public:
+    UploadJob(WorkerPool* workerPool);
+
+    /// Holds back all work of this job, until Resume() is called.
+    void Pause();
+
+    /// Continues a paused job.
+    void Resume();
+
+    /// Stops all uploads of this job. This can't be undone.
+    void Cancel();
+
+    /// Whether the job is currently paused.
+    bool IsPaused() const { return m_paused; }
+
+    /// Whether the job was cancelled.
+    bool IsCancelled() const { return m_cancelled; }
+
+    /// Whether all files of this job are done (uploaded, failed or cancelled), and no more files are going to be found.
+    ///
+    /// The scans are checked first, a scan only ends after it has added its files, so the job can't appear finished in between.
+    bool IsFinished() const { return m_pendingScans == 0 && m_remainingFiles == 0; }
+
+    /// The context to pass to all Azure Storage requests of this job. Cancelling the job aborts the requests that are in flight.
+    const Azure::Core::Context& GetContext() const { return m_context; }
+
+private:
+    friend class FileUploader;
+
+    /// Queues work of this job in the worker pool.
+    ///
+    /// While the job is paused, the work is held back. Once the job is cancelled, the work is still executed,
+    /// so that it can clean up, it has to check IsCancelled() itself.
+    void Schedule(int64_t priority, std::function<void()> work);
+
+    /// Cancels the job and drops all work that is held back. Called when the worker pool shuts down.
+    void Detach();
+
+    struct HeldWork
+    {
+        int64_t m_priority = 0;
+        std::function<void()> m_work;
+    };
+
+    mutable std::mutex m_mutex;
+    WorkerPool* m_workerPool = nullptr;
+    std::vector<HeldWork> m_heldWork;
+    std::atomic<bool> m_paused = false;
+    std::atomic<bool> m_cancelled = false;
+    std::atomic<int> m_remainingFiles = 0;
+    std::atomic<int> m_pendingScans = 0;
+    Azure::Core::Context m_context;
+};
@@ -0,0 +1,122 @@
+#include <QCryptographicHash>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+#include <Storage/UploadJournal.h>
+
+bool UploadJournal::Header::operator==(const Header& rhs) const
+{
+    return m_sourceFilePath == rhs.m_sourceFilePath &&
+           m_fileSize == rhs.m_fileSize &&
+           m_lastModified == rhs.m_lastModified &&
+           m_blockSize == rhs.m_blockSize;
+}
+
+QString UploadJournal::GetJournalPath(const QString& accountName, const QString& containerName, const QString& blobPath)
+{
+    QDir journalDir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/UploadJournals";
+    journalDir.mkpath(QString("."));
+
+    // blob paths can be longer than what the file system allows, so use a hash of the full blob URL as the file name
+    const QByteArray hash = QCryptographicHash::hash(QString("%1/%2/%3").arg(accountName).arg(containerName).arg(blobPath).toUtf8(), QCryptographicHash::Sha1);
+
+    return journalDir.absoluteFilePath(QString(hash.toHex()) + ".journal");
+}
+
+bool UploadJournal::Load(const QString& journalPath, const Header& header, std::vector<UploadBlock>& outStagedBlocks)
+{
+    outStagedBlocks.clear();
+
+    QFile file(journalPath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    {
+        const QJsonObject obj = QJsonDocument::fromJson(file.readLine()).object();
+
+        Header stored;
+        stored.m_sourceFilePath = obj["source"].toString();
+        stored.m_fileSize = obj["size"].toInteger();
+        stored.m_lastModified = obj["modified"].toInteger();
+        stored.m_blockSize = obj["block_size"].toInteger();
+
+        if (!(stored == header))
+            return false;
+    }
+
+    while (!file.atEnd())
+    {
+        const QList<QByteArray> parts = file.readLine().trimmed().split(' ');
+
+        // an incomplete last line is expected, if the application was terminated while writing it
+        if (parts.size() != 3)
+            continue;
+
+        UploadBlock block;
+        block.m_id = parts[0].toStdString();
+        block.m_offset = parts[1].toLongLong();
+        block.m_size = parts[2].toLongLong();
+        outStagedBlocks.push_back(block);
+    }
+
+    return true;
+}
+
+void UploadJournal::Remove(const QString& journalPath)
+{
+    QFile::remove(journalPath);
+}
+
+bool UploadJournal::Start(const QString& journalPath, const Header& header, const std::vector<UploadBlock>& stagedBlocks)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_file.setFileName(journalPath);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    QJsonObject obj;
+    obj["source"] = header.m_sourceFilePath;
+    obj["size"] = header.m_fileSize;
+    obj["modified"] = header.m_lastModified;
+    obj["block_size"] = header.m_blockSize;
+
+    m_file.write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+    m_file.write("\n");
+
+    for (const UploadBlock& block : stagedBlocks)
+    {
+        WriteBlock(block);
+    }
+
+    m_file.flush();
+    return true;
+}
+
+void UploadJournal::AddStagedBlock(const UploadBlock& block)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_file.isOpen())
+        return;
+
+    WriteBlock(block);
+    m_file.flush();
+}
+
+void UploadJournal::Finish()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_file.isOpen())
+        return;
+
+    m_file.close();
+    m_file.remove();
+}
+
+void UploadJournal::WriteBlock(const UploadBlock& block)
+{
+    m_file.write(QString("%1 %2 %3\n").arg(block.m_id.c_str()).arg(block.m_offset).arg(block.m_size).toUtf8());
+}
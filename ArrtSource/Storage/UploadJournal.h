@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QFile>
+#include <QString>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// One block ('chunk') of a file that gets uploaded to a block blob.
+struct UploadBlock
+{
+    std::string m_id;
+    int64_t m_offset = 0;
+    int64_t m_size = 0;
+};
+
+/// Keeps a local record of which blocks of a file upload have already been staged.
+///
+/// If an upload gets interrupted, the journal allows to only stage the missing blocks when the upload is restarted.
+/// The journal is a small text file: the first line describes the source file, every following line one staged block.
+/// Lines are only ever appended, so a journal that was cut short by a crash loses at most the last block.
+class UploadJournal
+{
+public:
+    /// Describes the source file, a journal is only valid as long as the source file doesn't change.
+    struct Header
+    {
+        QString m_sourceFilePath;
+        int64_t m_fileSize = 0;
+        int64_t m_lastModified = 0;
+        int64_t m_blockSize = 0;
+
+        bool operator==(const Header& rhs) const;
+    };
+
+    /// Returns where the journal for the given blob is stored.
+    static QString GetJournalPath(const QString& accountName, const QString& containerName, const QString& blobPath);
+
+    /// Reads the blocks that an earlier upload has staged.
+    ///
+    /// Returns false if there is no journal, or if it was written for a different version of the source file.
+    static bool Load(const QString& journalPath, const Header& header, std::vector<UploadBlock>& outStagedBlocks);
+
+    /// Deletes the journal file.
+    static void Remove(const QString& journalPath);
+
+    /// Starts a new journal, replacing any existing one. 'stagedBlocks' are the blocks that are already known to be staged.
+    bool Start(const QString& journalPath, const Header& header, const std::vector<UploadBlock>& stagedBlocks);
+
+    /// Records that a block has been staged successfully. Can be called from multiple threads.
+    void AddStagedBlock(const UploadBlock& block);
+
+    /// Closes and deletes the journal, once the upload has been committed.
+    void Finish();
+
+private:
+    void WriteBlock(const UploadBlock& block);
+
+    std::mutex m_mutex;
+    QFile m_file;
+};
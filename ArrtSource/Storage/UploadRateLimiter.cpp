@@ -0,0 +1,74 @@
+#include <Storage/UploadRateLimiter.h>
+#include <algorithm>
+#include <thread>
+
+// the bucket holds this many seconds worth of tokens
+static constexpr double s_burstSeconds = 0.25;
+
+// never let the bucket get smaller than this, otherwise low limits would result in tiny reads
+static constexpr double s_minCapacity = 64.0 * 1024.0;
+
+// waiting workers check this often whether the limit was changed
+static constexpr std::chrono::milliseconds s_maxWaitTime(100);
+
+void UploadRateLimiter::SetLimit(int64_t bytesPerSecond)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Refill(std::chrono::steady_clock::now());
+
+    m_bytesPerSecond = std::max<int64_t>(0, bytesPerSecond);
+    m_tokens = std::min(m_tokens, GetCapacity());
+}
+
+int64_t UploadRateLimiter::GetLimit() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytesPerSecond;
+}
+
+size_t UploadRateLimiter::Acquire(size_t bytes)
+{
+    if (bytes == 0)
+        return 0;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true)
+    {
+        if (m_bytesPerSecond <= 0)
+            return bytes;
+
+        const auto now = std::chrono::steady_clock::now();
+        Refill(now);
+
+        // never ask for more than the bucket can hold, otherwise this would wait forever
+        const double needed = std::min<double>((double)bytes, GetCapacity());
+
+        if (m_tokens >= needed)
+        {
+            m_tokens -= needed;
+            return std::max<size_t>(1, (size_t)needed);
+        }
+
+        const double missingSeconds = (needed - m_tokens) / m_bytesPerSecond;
+        const auto waitTime = std::min<std::chrono::steady_clock::duration>(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(missingSeconds)), s_maxWaitTime);
+
+        lock.unlock();
+        std::this_thread::sleep_for(waitTime);
+        lock.lock();
+    }
+}
+
+void UploadRateLimiter::Refill(std::chrono::steady_clock::time_point now)
+{
+    const double elapsedSeconds = std::chrono::duration<double>(now - m_lastRefill).count();
+    m_lastRefill = now;
+
+    m_tokens = std::min(m_tokens + elapsedSeconds * m_bytesPerSecond, GetCapacity());
+}
+
+double UploadRateLimiter::GetCapacity() const
+{
+    return std::max(s_minCapacity, m_bytesPerSecond * s_burstSeconds);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+/// Limits how many bytes per second all upload workers together may send.
+///
+/// This is a token bucket: tokens trickle in at the configured rate and every byte that is read for sending uses up one token.
+/// The bucket only holds a fraction of a second worth of tokens, so that the limit also holds over short periods of time.
+/// The limit can be changed at any time, waiting workers pick up the new value right away.
+class UploadRateLimiter
+{
+public:
+    /// Sets the maximum upload rate. Zero means unlimited.
+    void SetLimit(int64_t bytesPerSecond);
+
+    /// Returns the maximum upload rate. Zero means unlimited.
+    int64_t GetLimit() const;
+
+    /// Waits until some of the requested bytes may be sent and returns how many.
+    ///
+    /// The result is between 1 and 'bytes' (or 0, if 'bytes' is 0).
+    size_t Acquire(size_t bytes);
+
+private:
+    void Refill(std::chrono::steady_clock::time_point now);
+    double GetCapacity() const;
+
+    mutable std::mutex m_mutex;
+    int64_t m_bytesPerSecond = 0;
+    double m_tokens = 0.0;
+    std::chrono::steady_clock::time_point m_lastRefill = std::chrono::steady_clock::now();
+};
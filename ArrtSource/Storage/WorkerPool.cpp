@@ -0,0 +1,222 @@
+#include <Storage/WorkerPool.h>
+#include <algorithm>
+
+WorkerPool::WorkerPool(int maxWorkers)
+    : m_maxWorkers(std::max(1, maxWorkers))
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+        m_jobs = {};
+        m_delayedJobs = {};
+    }
+
+    m_wakeUp.notify_all();
+
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+void WorkerPool::SetMaxWorkers(int maxWorkers)
+{
+    std::vector<std::thread> finishedThreads;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_maxWorkers = std::max(1, maxWorkers);
+        finishedThreads = TakeFinishedThreads();
+
+        // a higher limit lets more workers help with the jobs that are already queued
+        StartWorkersForQueuedJobs();
+
+        // wake up idle workers, so that excess ones can quit
+        m_wakeUp.notify_all();
+    }
+
+    for (auto& thread : finishedThreads)
+    {
+        thread.join();
+    }
+}
+
+int WorkerPool::GetMaxWorkers() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_maxWorkers;
+}
+
+void WorkerPool::AddJob(int64_t priority, Job job)
+{
+    std::vector<std::thread> finishedThreads;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_shutdown)
+            return;
+
+        m_jobs.push({priority, m_nextSequence++, std::move(job)});
+
+        // a new thread may replace one that quit earlier, that one is joined now, so that the list doesn't keep growing
+        finishedThreads = TakeFinishedThreads();
+        StartWorkersForQueuedJobs();
+    }
+
+    m_wakeUp.notify_one();
+
+    for (auto& thread : finishedThreads)
+    {
+        thread.join();
+    }
+}
+
+void WorkerPool::AddDelayedJob(std::chrono::milliseconds delay, int64_t priority, Job job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_shutdown)
+            return;
+
+        m_delayedJobs.push({std::chrono::steady_clock::now() + delay, {priority, m_nextSequence++, std::move(job)}});
+
+        // the job is only added to the queue by a worker, so there has to be at least one
+        if (m_numWorkers == 0)
+        {
+            StartWorker();
+        }
+    }
+
+    // an idle worker may be waiting for a later job, or for none at all
+    m_wakeUp.notify_one();
+}
+
+void WorkerPool::RunDelayedJobsNow()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    QueueDueJobs(std::chrono::steady_clock::time_point::max());
+}
+
+void WorkerPool::WaitUntilIdle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this]()
+                { return m_jobs.empty() && m_delayedJobs.empty() && m_runningJobs == 0; });
+}
+
+void WorkerPool::QueueDueJobs(std::chrono::steady_clock::time_point now)
+{
+    bool queued = false;
+
+    while (!m_delayedJobs.empty() && m_delayedJobs.top().m_dueTime <= now)
+    {
+        m_jobs.push(m_delayedJobs.top().m_job);
+        m_delayedJobs.pop();
+        queued = true;
+    }
+
+    // several jobs may be due at once, the other idle workers and new ones can help with them
+    if (queued)
+    {
+        StartWorkersForQueuedJobs();
+        m_wakeUp.notify_all();
+    }
+}
+
+void WorkerPool::StartWorkersForQueuedJobs()
+{
+    // every queued job needs a worker that is idle, or about to take it, as long as the limit allows
+    // counting only the idle workers isn't enough, one idle worker would otherwise get all jobs that are queued at once
+    while ((int64_t)m_jobs.size() > m_idleWorkers && m_numWorkers < m_maxWorkers)
+    {
+        StartWorker();
+    }
+}
+
+void WorkerPool::StartWorker()
+{
+    // the new worker counts as idle right away, it takes one of the queued jobs as soon as it runs
+    ++m_numWorkers;
+    ++m_idleWorkers;
+    m_threads.emplace_back([this]()
+                           { WorkerThread(); });
+}
+
+void WorkerPool::WorkerThread()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // the worker was counted as idle when it was started, and again after every job
+    while (true)
+    {
+        // idle workers wake up when the next delayed job is due
+        while (true)
+        {
+            QueueDueJobs(std::chrono::steady_clock::now());
+
+            if (m_shutdown || !m_jobs.empty() || m_numWorkers > m_maxWorkers)
+                break;
+
+            if (m_delayedJobs.empty())
+            {
+                m_wakeUp.wait(lock);
+            }
+            else
+            {
+                // the time is copied, the job it belongs to may be gone by the time the wait ends
+                const auto dueTime = m_delayedJobs.top().m_dueTime;
+                m_wakeUp.wait_until(lock, dueTime);
+            }
+        }
+
+        --m_idleWorkers;
+
+        if (m_shutdown || m_numWorkers > m_maxWorkers)
+        {
+            --m_numWorkers;
+            m_finishedThreads.push_back(std::this_thread::get_id());
+            return;
+        }
+
+        Job job = m_jobs.top().m_job;
+        m_jobs.pop();
+        ++m_runningJobs;
+
+        lock.unlock();
+        job();
+        lock.lock();
+
+        ++m_idleWorkers;
+
+        if (--m_runningJobs == 0 && m_jobs.empty() && m_delayedJobs.empty())
+        {
+            m_idle.notify_all();
+        }
+    }
+}
+
+std::vector<std::thread> WorkerPool::TakeFinishedThreads()
+{
+    std::vector<std::thread> finishedThreads;
+
+    for (const std::thread::id& id : m_finishedThreads)
+    {
+        auto it = std::find_if(m_threads.begin(), m_threads.end(), [&id](const std::thread& thread)
+                               { return thread.get_id() == id; });
+
+        if (it != m_threads.end())
+        {
+            finishedThreads.push_back(std::move(*it));
+            m_threads.erase(it);
+        }
+    }
+
+    m_finishedThreads.clear();
+    return finishedThreads;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/// A bounded pool of worker threads that executes background jobs, such as uploads and storage listings.
+///
+/// All jobs go into one shared queue. Whenever a worker becomes idle, it takes the next pending job,
+/// so no worker sits idle while there is still work left. Jobs with a higher priority are executed first,
+/// jobs with equal priority in the order in which they were added.
+/// Delayed jobs wait outside of the queue, so they don't occupy a worker until they are due.
+class WorkerPool
+{
+public:
+    using Job = std::function<void()>;
+
+    WorkerPool(int maxWorkers);
+
+    /// Discards all pending and delayed jobs and waits for the running jobs to finish.
+    ~WorkerPool();
+
+    /// Changes how many worker threads may run at the same time.
+    ///
+    /// Raising the number starts workers for the jobs that are already queued. Reducing it doesn't interrupt running jobs, excess workers quit once they have finished their current job.
+    void SetMaxWorkers(int maxWorkers);
+
+    /// Returns how many worker threads may run at the same time.
+    int GetMaxWorkers() const;
+
+    /// Adds a job to the queue. Starts more worker threads, if there are more queued jobs than idle workers and the limit isn't reached yet.
+    void AddJob(int64_t priority, Job job);
+
+    /// Adds a job to the queue once the delay has passed, for example to retry something that failed.
+    void AddDelayedJob(std::chrono::milliseconds delay, int64_t priority, Job job);
+
+    /// Adds all delayed jobs to the queue right away, for example because their work was cancelled and they only need to clean up.
+    void RunDelayedJobsNow();
+
+    /// Blocks until the queue is empty, no delayed job is left and no job is running anymore.
+    ///
+    /// Jobs that are added while waiting, are waited for as well.
+    void WaitUntilIdle();
+
+private:
+    struct PendingJob
+    {
+        int64_t m_priority = 0;
+        uint64_t m_sequence = 0;
+        Job m_job;
+
+        bool operator<(const PendingJob& rhs) const
+        {
+            if (m_priority != rhs.m_priority)
+                return m_priority < rhs.m_priority;
+
+            return m_sequence > rhs.m_sequence;
+        }
+    };
+
+    struct DelayedJob
+    {
+        std::chrono::steady_clock::time_point m_dueTime;
+        PendingJob m_job;
+
+        bool operator<(const DelayedJob& rhs) const
+        {
+            return m_dueTime > rhs.m_dueTime;
+        }
+    };
+
+    void WorkerThread();
+
+    /// Moves the delayed jobs whose time has come into the queue and wakes up the idle workers for them.
+    void QueueDueJobs(std::chrono::steady_clock::time_point now);
+
+    /// Starts worker threads until there is an idle worker for every queued job, or the limit is reached.
+    void StartWorkersForQueuedJobs();
+
+    void StartWorker();
+
+    /// Removes the threads of workers that have quit from m_threads, the caller has to join them after releasing the lock.
+    std::vector<std::thread> TakeFinishedThreads();
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_idle;
+    std::priority_queue<PendingJob> m_jobs;
+    std::priority_queue<DelayedJob> m_delayedJobs; ///< The job that is due next is on top.
+    std::vector<std::thread> m_threads;
+    std::vector<std::thread::id> m_finishedThreads; ///< Workers that have quit, but whose threads haven't been joined yet.
+    uint64_t m_nextSequence = 0;
+    int m_maxWorkers = 1;
+    int m_numWorkers = 0;
+    int m_idleWorkers = 0;
+    int m_runningJobs = 0;
+    bool m_shutdown = false;
+};